@@ -126,6 +126,16 @@ CBlockArchive& CBlockArchive::operator<<(const std::string& strVal)
     return *this;
 }
 
+CBlockArchive& CBlockArchive::operator<<(const StringHelper::CInternedString& strVal)
+{
+    (*this)<<(unsigned __int32)strVal.length();
+
+    m_refBuf.replace(m_uCursor, strVal.length(), strVal.c_str(), strVal.length());
+    m_uCursor += strVal.length();
+
+    return *this;
+}
+
 CBlockArchive& CBlockArchive::operator<<(bool bVal)
 {
     return (*this) << (__int8)bVal;
@@ -276,6 +286,23 @@ CBlockArchive& CBlockArchive::operator>>(std::string &strVal)
 
     return *this;
 }
+CBlockArchive& CBlockArchive::operator>>(StringHelper::CInternedString &strVal)
+{
+    unsigned __int32 dwLen = 0;
+    (*this) >> dwLen;
+
+    if (m_uCursor + dwLen <= m_refBuf.length())
+    {
+        strVal = StringHelper::Intern(std::string_view(m_refBuf.data() + m_uCursor, dwLen));
+        m_uCursor += dwLen;
+    }
+    else
+    {
+        throw std::out_of_range("invalid buffer position");
+    }
+
+    return *this;
+}
 CBlockArchive& CBlockArchive::operator>>(bool &bVal)
 {
     __int8 chTemp;
@@ -13,6 +13,7 @@
 #include <vector>
 #include <list>
 #include <map>
+#include "StringPool.h"
 
 //////////////////////////////////////////////////////////////////////////
 // 本类的使用要注意事项和方法：
@@ -51,6 +52,7 @@ public:
     CBlockArchive& operator<<(__int64 dwdwVal);
     CBlockArchive& operator<<(unsigned __int64 dwdwVal);
     CBlockArchive& operator<<(const std::string& strVal);
+    CBlockArchive& operator<<(const StringHelper::CInternedString& strVal);
     CBlockArchive& operator<<(bool bVal);
     CBlockArchive& operator<<(float fVal);
     CBlockArchive& operator<<(double dbVal);
@@ -65,6 +67,8 @@ public:
     CBlockArchive& operator>>(__int64 &dwdwVal);
     CBlockArchive& operator>>(unsigned __int64 &dwdwVal);
     CBlockArchive& operator>>(std::string &strVal);
+    // 直接从缓存驻留到全局池，不产生临时字符串
+    CBlockArchive& operator>>(StringHelper::CInternedString &strVal);
     CBlockArchive& operator>>(bool &bVal);
     CBlockArchive& operator>>(float &fVal);
     CBlockArchive& operator>>(double &dbVal);
@@ -103,7 +107,7 @@ template<class T>
 CBlockArchive& operator<<(CBlockArchive& ar, const std::list<T>& lstVals)
 {
     ar <<(unsigned __int32)lstVals.size();
-    std::list<T>::const_iterator iter = lstVals.begin();
+    typename std::list<T>::const_iterator iter = lstVals.begin();
     for(; iter != lstVals.end(); ++iter)
     {
         ar << *iter;
@@ -117,7 +121,7 @@ CBlockArchive& operator>>(CBlockArchive& ar, std::list<T>& lstVals)
     unsigned __int32 dwSize = 0;
     ar >> dwSize;
     lstVals.resize(dwSize);
-    std::list<T>::iterator iter = lstVals.begin();
+    typename std::list<T>::iterator iter = lstVals.begin();
     for(; iter != lstVals.end(); ++iter)
     {
         ar >> *iter;
@@ -130,7 +134,7 @@ template<class _Kty, class _Ty>
 CBlockArchive& operator<<(CBlockArchive& ar, const std::map<_Kty, _Ty>& mapVals)
 {
     ar <<(unsigned __int32)mapVals.size();
-    std::map<_Kty, _Ty>::const_iterator iter = mapVals.begin();
+    typename std::map<_Kty, _Ty>::const_iterator iter = mapVals.begin();
     for(; iter != mapVals.end(); ++iter)
     {
         ar << iter->first;
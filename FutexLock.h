@@ -0,0 +1,165 @@
+/********************************************************************
+	filename: 	FutexLock.h
+
+	purpose:	基于futex的自适应互斥锁，Linux下CCriticalSectionLock的替代
+	            无竞争时加锁、解锁各一次原子操作，不进内核；
+	            竞争时先带指数退避地自旋，仍拿不到再挂起到futex上
+	            Windows下等待/唤醒改用WaitOnAddress(需Win8及以上)
+	            注意：与CRITICAL_SECTION不同，本锁不可重入
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include "LockHelper.h"
+
+#ifdef _WIN32
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#else
+#error "FutexLock.h: unsupported platform"
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace LockDetail
+{
+    // 自旋等待时让出流水线，超线程下把执行资源让给另一个逻辑核
+    inline void CpuRelax()
+    {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+        _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    /** @fn inline bool FutexWait(std::atomic<uint32_t>* pAddr, uint32_t uExpected, uint32_t uTimeoutMs = (uint32_t)-1)
+     *  @brief *pAddr仍等于uExpected时挂起，直到被FutexWake唤醒、超时或伪唤醒
+     *    调用方须在返回后重新检查条件
+     *  @return bool 超时返回false
+     */
+    inline bool FutexWait(std::atomic<uint32_t>* pAddr, uint32_t uExpected, uint32_t uTimeoutMs = (uint32_t)-1)
+    {
+#ifdef _WIN32
+        if(!WaitOnAddress(pAddr, &uExpected, sizeof(uExpected), (uTimeoutMs == (uint32_t)-1) ? INFINITE : uTimeoutMs))
+        {
+            return GetLastError() != ERROR_TIMEOUT;
+        }
+        return true;
+#else
+        struct timespec ts;
+        struct timespec* pTs = NULL;
+        if(uTimeoutMs != (uint32_t)-1)
+        {
+            ts.tv_sec = uTimeoutMs / 1000;
+            ts.tv_nsec = (long)(uTimeoutMs % 1000) * 1000000;
+            pTs = &ts;
+        }
+        long nRet = syscall(SYS_futex, reinterpret_cast<uint32_t*>(pAddr), FUTEX_WAIT_PRIVATE, uExpected, pTs, NULL, 0);
+        return !(nRet != 0 && ETIMEDOUT == errno);
+#endif
+    }
+
+    // 唤醒至多nCount个等待在pAddr上的线程
+    inline void FutexWake(std::atomic<uint32_t>* pAddr, int nCount)
+    {
+#ifdef _WIN32
+        if(1 == nCount)
+        {
+            WakeByAddressSingle(pAddr);
+        }
+        else
+        {
+            WakeByAddressAll(pAddr);
+        }
+#else
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(pAddr), FUTEX_WAKE_PRIVATE, nCount, NULL, NULL, 0);
+#endif
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 状态：0空闲，1已锁无等待者，2已锁且可能有线程挂起
+// 解锁时只有状态为2才需要系统调用唤醒
+//////////////////////////////////////////////////////////////////////////
+class CFutexLock final : public ISmartLock
+{
+public:
+    enum
+    {
+        SPIN_ROUNDS = 10,   // 挂起前的自旋轮数
+        MAX_BACKOFF = 16,   // 每轮pause次数从1倍增到此为止
+    };
+
+    CFutexLock()
+        : m_uState(0)
+    {
+    }
+
+private: // 拒绝拷贝
+    CFutexLock(const CFutexLock&);
+    CFutexLock& operator=(const CFutexLock&);
+
+public:
+    void Lock()
+    {
+        uint32_t uState = 0;
+        if(!m_uState.compare_exchange_strong(uState, 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            LockSlow();
+        }
+    }
+
+    void Unlock()
+    {
+        if(2 == m_uState.exchange(0, std::memory_order_release))
+        {
+            LockDetail::FutexWake(&m_uState, 1);
+        }
+    }
+
+    bool TryLock()
+    {
+        uint32_t uState = 0;
+        return m_uState.compare_exchange_strong(uState, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+private:
+    void LockSlow()
+    {
+        // 自旋阶段只读不写，锁释放后才尝试CAS，避免多核下缓存行来回失效
+        uint32_t uBackoff = 1;
+        for(int nRound = 0; nRound < SPIN_ROUNDS; ++nRound)
+        {
+            for(uint32_t i = 0; i < uBackoff; ++i)
+            {
+                LockDetail::CpuRelax();
+            }
+            if(uBackoff < MAX_BACKOFF)
+            {
+                uBackoff <<= 1;
+            }
+            uint32_t uState = m_uState.load(std::memory_order_relaxed);
+            if(0 == uState && m_uState.compare_exchange_weak(uState, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+
+        // 挂起阶段：置为2表示有等待者，换出0即拿到锁（此时保守地保持为2）
+        while(m_uState.exchange(2, std::memory_order_acquire) != 0)
+        {
+            LockDetail::FutexWait(&m_uState, 2);
+        }
+    }
+
+private:
+    std::atomic<uint32_t>   m_uState;
+};
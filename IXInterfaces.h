@@ -486,7 +486,35 @@ private: // 拒绝拷贝
 private:
     IXSmartLock* m_pLock;
 };
-#define VX_SCOPED_SAFELOCK(cs) VxLockHelper VX_CAT_TOKEN(lock_, __LINE__)(cs)
+
+// 同MakeScopedLock，非模板重载保留IXSmartLock*的虚函数路径（NULL、可转换为接口指针的对象）
+template<class T>
+inline TLockHelper<T> MakeVxScopedLock(T* pLock)
+{
+    return TLockHelper<T>(pLock);
+}
+
+inline VxLockHelper MakeVxScopedLock(IXSmartLock* pLock)
+{
+    return VxLockHelper(pLock);
+}
+
+#ifdef LOCK_PROFILING
+template<class T>
+inline CProfiledLockHelper<T> MakeVxProfiledLock(T* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<T>(pLock, site);
+}
+
+inline CProfiledLockHelper<IXSmartLock> MakeVxProfiledLock(IXSmartLock* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<IXSmartLock>(pLock, site);
+}
+
+#define VX_SCOPED_SAFELOCK(cs) auto VX_CAT_TOKEN(lock_, __LINE__) = MakeVxProfiledLock(cs, LOCK_PROFILE_SITE(#cs))
+#else
+#define VX_SCOPED_SAFELOCK(cs) auto VX_CAT_TOKEN(lock_, __LINE__) = MakeVxScopedLock(cs)
+#endif
 #pragma endregion
 
 #define _IID_IXInterface  "{F9F27C3C-5A5C-4C39-B8B4-D3FEC6A609C9}"
@@ -0,0 +1,459 @@
+/********************************************************************
+	filename: 	LineReader.h
+
+	purpose:	按行/按记录读取文件，记录以string_view返回，不逐行拷贝
+	            普通文件整体只读映射，记录直接指向映射区，在Close前一直有效；
+	            管道、FIFO、控制台等无法映射时退化为分块流式读取，
+	            此时记录只在下一次Next前有效
+	            映射模式下可用SplitRanges把内容按记录边界切成若干段交给多个线程解析
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+#include "StringScan.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // 分隔符为'\n'时去掉行尾的'\r'，兼容CRLF
+        inline std::string_view TrimRecordCR(std::string_view sRecord, char chDelim, bool bStripCR)
+        {
+            if(bStripCR && '\n' == chDelim && !sRecord.empty() && '\r' == sRecord.back())
+            {
+                sRecord.remove_suffix(1);
+            }
+            return sRecord;
+        }
+    }
+
+    /** @fn inline void SplitRanges(std::string_view s, size_t nParts, std::vector<std::string_view>& vecRanges, char chDelim = '\n')
+     *  @brief 把s切成至多nParts段，每段都以完整的记录结束（最后一段可能没有结尾的分隔符），
+     *    各段大小大致相等，可分别交给ForEachRecord并行解析
+     */
+    inline void SplitRanges(std::string_view s, size_t nParts, std::vector<std::string_view>& vecRanges, char chDelim = '\n')
+    {
+        if(0 == nParts)
+        {
+            nParts = 1;
+        }
+        size_t uBegin = 0;
+        for(size_t i = 1; i <= nParts && uBegin < s.length(); ++i)
+        {
+            size_t uEnd = s.length();
+            if(i < nParts)
+            {
+                size_t uTarget = s.length() / nParts * i;
+                if(uTarget < uBegin)
+                {
+                    uTarget = uBegin;
+                }
+                size_t uDelim = FindChar(s, chDelim, uTarget);
+                uEnd = (std::string_view::npos == uDelim) ? s.length() : uDelim + 1;
+            }
+            vecRanges.push_back(s.substr(uBegin, uEnd - uBegin));
+            uBegin = uEnd;
+        }
+    }
+
+    /** @fn inline size_t ForEachRecord(std::string_view s, Fn fn, char chDelim = '\n', bool bStripCR = true)
+     *  @brief 逐条回调s中的记录，fn签名为void(string_view)或bool(string_view)，返回false时提前结束
+     *    末尾没有分隔符的残余部分也算一条记录
+     *  @return size_t 回调的记录数
+     */
+    template<class Fn>
+    inline size_t ForEachRecord(std::string_view s, Fn fn, char chDelim = '\n', bool bStripCR = true)
+    {
+        CCharCursor cursor(s, chDelim);
+        size_t uPos = 0;
+        size_t nCount = 0;
+        while(uPos < s.length())
+        {
+            size_t uDelim = cursor.Next();
+            size_t uEnd = (std::string_view::npos == uDelim) ? s.length() : uDelim;
+            std::string_view sRecord = detail::TrimRecordCR(s.substr(uPos, uEnd - uPos), chDelim, bStripCR);
+            uPos = uEnd + 1;
+            ++nCount;
+            if constexpr (std::is_same<decltype(fn(sRecord)), bool>::value)
+            {
+                if(!fn(sRecord))
+                {
+                    break;
+                }
+            }
+            else
+            {
+                fn(sRecord);
+            }
+        }
+        return nCount;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 记录读取器
+    //     CLineReader reader;
+    //     if(reader.Open("big.log"))
+    //     {
+    //         std::string_view sLine;
+    //         while(reader.Next(sLine)) { ... }
+    //     }
+    //////////////////////////////////////////////////////////////////////////
+    class CLineReader
+    {
+    public:
+        enum
+        {
+            STREAM_CHUNK = 256 * 1024,  // 流式读取时每次读入的大小，超长记录会使缓冲区按倍数增长
+        };
+
+        explicit CLineReader(char chDelim = '\n', bool bStripCR = true)
+            : m_chDelim(chDelim)
+            , m_bStripCR(bStripCR)
+            , m_cursor(std::string_view(), chDelim)
+        {
+            Reset();
+        }
+
+        ~CLineReader()
+        {
+            Close();
+        }
+
+    private: // 拒绝拷贝
+        CLineReader(const CLineReader&);
+        CLineReader& operator=(const CLineReader&);
+
+    public:
+        /** @fn bool Open(const char* pszPath)
+         *  @brief 打开文件，普通文件走映射，其余走流式读取
+         *  @return bool 文件无法打开或映射失败时返回false
+         */
+        bool Open(const char* pszPath)
+        {
+            Close();
+#ifdef _WIN32
+            HANDLE hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if(INVALID_HANDLE_VALUE == hFile)
+            {
+                return false;
+            }
+            return Attach(hFile, true);
+#else
+            int fd = open(pszPath, O_RDONLY | O_CLOEXEC);
+            if(fd < 0)
+            {
+                return false;
+            }
+            return Attach(fd, true);
+#endif
+        }
+
+        // 读取标准输入，被重定向为普通文件时同样走映射
+        bool OpenStdin()
+        {
+            Close();
+#ifdef _WIN32
+            return Attach(GetStdHandle(STD_INPUT_HANDLE), false);
+#else
+            return Attach(STDIN_FILENO, false);
+#endif
+        }
+
+        void Close()
+        {
+#ifdef _WIN32
+            if(m_pView)
+            {
+                UnmapViewOfFile(m_pView);
+            }
+            if(m_hFile != INVALID_HANDLE_VALUE && m_bOwnFile)
+            {
+                CloseHandle(m_hFile);
+            }
+#else
+            if(m_pView)
+            {
+                munmap(m_pView, m_data.length());
+            }
+            if(m_fd >= 0 && m_bOwnFile)
+            {
+                close(m_fd);
+            }
+#endif
+            std::vector<char>().swap(m_vecBuf);
+            Reset();
+        }
+
+        /** @fn bool Next(std::string_view& sRecord)
+         *  @brief 取下一条记录（不含分隔符），末尾没有分隔符的残余部分也算一条记录
+         *  @return bool 没有更多记录或读取出错时返回false，可用HasError区分
+         */
+        bool Next(std::string_view& sRecord)
+        {
+            return IsMapped() ? NextMapped(sRecord) : NextStreamed(sRecord);
+        }
+
+    public:
+        bool IsOpen() const
+        {
+#ifdef _WIN32
+            return m_hFile != INVALID_HANDLE_VALUE;
+#else
+            return m_fd >= 0;
+#endif
+        }
+
+        // 是否为映射模式，只有映射模式下Data可用、记录在Close前一直有效
+        bool IsMapped() const
+        {
+            return m_bMapped;
+        }
+
+        // 映射模式下的整个文件内容，可配合SplitRanges/ForEachRecord并行解析
+        std::string_view Data() const
+        {
+            return m_data;
+        }
+
+        bool HasError() const
+        {
+            return m_bError;
+        }
+
+    private:
+        void Reset()
+        {
+#ifdef _WIN32
+            m_hFile = INVALID_HANDLE_VALUE;
+#else
+            m_fd = -1;
+#endif
+            m_bOwnFile = false;
+            m_bMapped = false;
+            m_bEof = false;
+            m_bError = false;
+            m_pView = NULL;
+            m_data = std::string_view();
+            m_cursor = CCharCursor(std::string_view(), m_chDelim);
+            m_uPos = 0;
+            m_uBegin = 0;
+            m_uEnd = 0;
+            m_uSearched = 0;
+        }
+
+#ifdef _WIN32
+        bool Attach(HANDLE hFile, bool bOwn)
+        {
+            if(NULL == hFile || INVALID_HANDLE_VALUE == hFile)
+            {
+                return false;
+            }
+            m_hFile = hFile;
+            m_bOwnFile = bOwn;
+
+            LARGE_INTEGER liSize;
+            if(FILE_TYPE_DISK != GetFileType(hFile) || !GetFileSizeEx(hFile, &liSize)
+                || (uint64_t)liSize.QuadPart > (uint64_t)(size_t)-1)
+            {
+                return true;    // 流式读取
+            }
+            m_bMapped = true;
+            if(0 == liSize.QuadPart)
+            {
+                return true;    // 空文件无法映射，也不需要映射
+            }
+            HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(NULL == hMapping)
+            {
+                Close();
+                return false;
+            }
+            m_pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hMapping);  // 视图持有映射对象的引用
+            if(NULL == m_pView)
+            {
+                Close();
+                return false;
+            }
+            SetMappedData((size_t)liSize.QuadPart);
+            return true;
+        }
+
+        size_t ReadSome(char* pBuf, size_t uLen)
+        {
+            DWORD dwRead = 0;
+            DWORD dwWant = (uLen > 0x40000000) ? 0x40000000 : (DWORD)uLen;
+            if(!ReadFile(m_hFile, pBuf, dwWant, &dwRead, NULL))
+            {
+                // 管道写端关闭视为正常结束
+                if(GetLastError() != ERROR_BROKEN_PIPE)
+                {
+                    m_bError = true;
+                }
+                return 0;
+            }
+            return dwRead;
+        }
+#else
+        bool Attach(int fd, bool bOwn)
+        {
+            m_fd = fd;
+            m_bOwnFile = bOwn;
+
+            struct stat st;
+            if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > (uint64_t)(size_t)-1)
+            {
+                return true;    // 流式读取
+            }
+            m_bMapped = true;
+            if(0 == st.st_size)
+            {
+                return true;    // 空文件无法映射，也不需要映射
+            }
+            void* pView = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(MAP_FAILED == pView)
+            {
+                Close();
+                return false;
+            }
+            madvise(pView, (size_t)st.st_size, MADV_SEQUENTIAL);
+            m_pView = pView;
+            SetMappedData((size_t)st.st_size);
+            return true;
+        }
+
+        size_t ReadSome(char* pBuf, size_t uLen)
+        {
+            while(true)
+            {
+                ssize_t nRead = read(m_fd, pBuf, uLen);
+                if(nRead >= 0)
+                {
+                    return (size_t)nRead;
+                }
+                if(errno != EINTR)
+                {
+                    m_bError = true;
+                    return 0;
+                }
+            }
+        }
+#endif
+
+        void SetMappedData(size_t uSize)
+        {
+            m_data = std::string_view(static_cast<const char*>(m_pView), uSize);
+            m_cursor = CCharCursor(m_data, m_chDelim);
+        }
+
+        bool NextMapped(std::string_view& sRecord)
+        {
+            if(m_uPos >= m_data.length())
+            {
+                return false;
+            }
+            size_t uDelim = m_cursor.Next();
+            size_t uEnd = (std::string_view::npos == uDelim) ? m_data.length() : uDelim;
+            sRecord = detail::TrimRecordCR(m_data.substr(m_uPos, uEnd - m_uPos), m_chDelim, m_bStripCR);
+            m_uPos = uEnd + 1;
+            return true;
+        }
+
+        // 缓冲区[m_uBegin, m_uEnd)为未消费的数据，其中[m_uBegin, m_uSearched)已确认不含分隔符
+        bool NextStreamed(std::string_view& sRecord)
+        {
+            if(!IsOpen())
+            {
+                return false;
+            }
+            while(true)
+            {
+                const char* pBuf = m_vecBuf.empty() ? NULL : &m_vecBuf[0];
+                const void* pHit = (m_uSearched < m_uEnd) ? memchr(pBuf + m_uSearched, m_chDelim, m_uEnd - m_uSearched) : NULL;
+                if(pHit)
+                {
+                    size_t uDelim = static_cast<const char*>(pHit) - pBuf;
+                    sRecord = detail::TrimRecordCR(std::string_view(pBuf + m_uBegin, uDelim - m_uBegin), m_chDelim, m_bStripCR);
+                    m_uBegin = m_uSearched = uDelim + 1;
+                    return true;
+                }
+                m_uSearched = m_uEnd;
+
+                if(m_bEof)
+                {
+                    if(m_uBegin == m_uEnd)
+                    {
+                        return false;
+                    }
+                    sRecord = detail::TrimRecordCR(std::string_view(pBuf + m_uBegin, m_uEnd - m_uBegin), m_chDelim, m_bStripCR);
+                    m_uBegin = m_uEnd;
+                    return true;
+                }
+                Fill();
+            }
+        }
+
+        // 把未消费的数据移到缓冲区头部，空间不足时扩容，再读入一块
+        void Fill()
+        {
+            if(m_uBegin > 0)
+            {
+                memmove(&m_vecBuf[0], &m_vecBuf[m_uBegin], m_uEnd - m_uBegin);
+                m_uEnd -= m_uBegin;
+                m_uSearched -= m_uBegin;
+                m_uBegin = 0;
+            }
+            if(m_vecBuf.size() - m_uEnd < STREAM_CHUNK / 2)
+            {
+                m_vecBuf.resize(m_vecBuf.empty() ? (size_t)STREAM_CHUNK : m_vecBuf.size() * 2);
+            }
+            size_t uRead = ReadSome(&m_vecBuf[m_uEnd], m_vecBuf.size() - m_uEnd);
+            if(0 == uRead)
+            {
+                m_bEof = true;
+            }
+            m_uEnd += uRead;
+        }
+
+    private:
+        const char          m_chDelim;
+        const bool          m_bStripCR;     /*分隔符为'\n'时是否去掉行尾的'\r'*/
+#ifdef _WIN32
+        HANDLE              m_hFile;
+#else
+        int                 m_fd;
+#endif
+        bool                m_bOwnFile;     /*Close时是否关闭文件*/
+        bool                m_bMapped;
+        bool                m_bEof;
+        bool                m_bError;
+
+        // 映射模式
+        void*               m_pView;
+        std::string_view    m_data;
+        CCharCursor         m_cursor;
+        size_t              m_uPos;         /*下一条记录的起始下标*/
+
+        // 流式模式
+        std::vector<char>   m_vecBuf;
+        size_t              m_uBegin;
+        size_t              m_uEnd;
+        size_t              m_uSearched;
+    };
+}
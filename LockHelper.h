@@ -6,8 +6,11 @@
 	purpose:	锁工具类，提供各种锁
 *********************************************************************/
 #pragma once
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <assert.h>
+#include <type_traits>
 
 struct ISmartLock
 {
@@ -15,7 +18,15 @@ struct ISmartLock
     virtual void Unlock()   = 0;
 };
 
-class CCriticalSectionLock : public ISmartLock
+// 读写锁：Lock/Unlock为独占（写），LockShared/UnlockShared为共享（读）
+struct ISharedLock : public ISmartLock
+{
+    virtual void LockShared()   = 0;
+    virtual void UnlockShared() = 0;
+};
+
+#ifdef _WIN32
+class CCriticalSectionLock final : public ISmartLock
 {
 public:
     CCriticalSectionLock()
@@ -52,7 +63,7 @@ private:
     CRITICAL_SECTION	m_CS;
 };
 
-class CMutexLock : public ISmartLock
+class CMutexLock final : public ISmartLock
 {
 public:
     CMutexLock(LPCTSTR name)
@@ -107,6 +118,7 @@ public:
     HANDLE	m_hMutex;
     bool    m_bAlreadyExist;
 };
+#endif // _WIN32
 
 class LockHelper
 {
@@ -135,6 +147,160 @@ private:
     ISmartLock* m_pLock;
 };
 
-#define SCOPED_SAFELOCK(cs) LockHelper lock(cs)
-#define SCOPED_SAFELOCK1(cs) LockHelper lock1(cs)
-#define SCOPED_SAFELOCK2(cs) LockHelper lock2(cs)
+//////////////////////////////////////////////////////////////////////////
+// 按锁的静态类型绑定的作用域锁，T为具体锁类型时Lock/Unlock可内联
+// T声明为final时用限定名调用，不经虚表；否则普通调用，由编译器视情况去虚化
+// T为ISmartLock等接口时与LockHelper行为相同
+// bShared为true时加共享锁(LockShared/UnlockShared)
+//////////////////////////////////////////////////////////////////////////
+template<class T, bool bShared = false>
+class TLockHelper
+{
+public:
+    explicit TLockHelper(T* pLock):m_pLock(pLock)
+    {
+        if(m_pLock)
+        {
+            if constexpr (bShared)
+            {
+                if constexpr (std::is_final<T>::value)
+                {
+                    m_pLock->T::LockShared();
+                }
+                else
+                {
+                    m_pLock->LockShared();
+                }
+            }
+            else
+            {
+                if constexpr (std::is_final<T>::value)
+                {
+                    m_pLock->T::Lock();
+                }
+                else
+                {
+                    m_pLock->Lock();
+                }
+            }
+        }
+    }
+
+    ~TLockHelper()
+    {
+        if(m_pLock)
+        {
+            if constexpr (bShared)
+            {
+                if constexpr (std::is_final<T>::value)
+                {
+                    m_pLock->T::UnlockShared();
+                }
+                else
+                {
+                    m_pLock->UnlockShared();
+                }
+            }
+            else
+            {
+                if constexpr (std::is_final<T>::value)
+                {
+                    m_pLock->T::Unlock();
+                }
+                else
+                {
+                    m_pLock->Unlock();
+                }
+            }
+        }
+    }
+
+private: // 拒绝拷贝
+    TLockHelper(const TLockHelper&);
+    TLockHelper& operator=(const TLockHelper&);
+
+private:
+    T* m_pLock;
+};
+
+/** @fn template<class T> TLockHelper<T> MakeScopedLock(T* pLock)
+ *  @brief 由指针类型推导出TLockHelper<T>，配合auto使用：auto lock = MakeScopedLock(&m_lock);
+ *    返回值直接构造在调用方变量上(C++17保证省略拷贝)，不需要拷贝构造
+ *  @param (IN) T* pLock 可为NULL，此时不加锁
+ */
+template<class T>
+inline TLockHelper<T> MakeScopedLock(T* pLock)
+{
+    return TLockHelper<T>(pLock);
+}
+
+template<class T>
+inline TLockHelper<T, true> MakeSharedScopedLock(T* pLock)
+{
+    return TLockHelper<T, true>(pLock);
+}
+
+// 非模板重载保留原来的虚函数路径：NULL/0/nullptr、可隐式转换为ISmartLock*的对象都匹配到这里
+inline LockHelper MakeScopedLock(ISmartLock* pLock)
+{
+    return LockHelper(pLock);
+}
+
+// 宏按参数的静态类型选用TLockHelper；接口指针、NULL及可转换为接口指针的参数仍走LockHelper，与原来一致
+// LOCK_PROFILING下同样按类型推导，两种编译方式接受的参数相同
+#ifdef LOCK_PROFILING
+#include "LockProfiler.h"
+#define SCOPED_SAFELOCK(cs) auto lock = MakeProfiledLock(cs, LOCK_PROFILE_SITE(#cs))
+#define SCOPED_SAFELOCK1(cs) auto lock1 = MakeProfiledLock(cs, LOCK_PROFILE_SITE(#cs))
+#define SCOPED_SAFELOCK2(cs) auto lock2 = MakeProfiledLock(cs, LOCK_PROFILE_SITE(#cs))
+#else
+#define SCOPED_SAFELOCK(cs) auto lock = MakeScopedLock(cs)
+#define SCOPED_SAFELOCK1(cs) auto lock1 = MakeScopedLock(cs)
+#define SCOPED_SAFELOCK2(cs) auto lock2 = MakeScopedLock(cs)
+#endif
+
+class SharedLockHelper
+{
+public:
+    SharedLockHelper(ISharedLock* pLock):m_pLock(pLock)
+    {
+        if(m_pLock)
+        {
+            m_pLock->LockShared();
+        }
+    }
+
+    ~SharedLockHelper()
+    {
+        if(m_pLock)
+        {
+            m_pLock->UnlockShared();
+        }
+    }
+
+private: // 拒绝拷贝
+    SharedLockHelper(const SharedLockHelper&);
+    SharedLockHelper& operator=(const SharedLockHelper&);
+
+private:
+    ISharedLock* m_pLock;
+};
+
+inline SharedLockHelper MakeSharedScopedLock(ISharedLock* pLock)
+{
+    return SharedLockHelper(pLock);
+}
+
+// 读写锁的独占加锁直接用SCOPED_SAFELOCK，以下两组名字只为读代码时一目了然
+#ifdef LOCK_PROFILING
+#define SCOPED_SHAREDLOCK(cs) auto lock = MakeSharedProfiledLock(cs, LOCK_PROFILE_SITE("shared " #cs))
+#define SCOPED_SHAREDLOCK1(cs) auto lock1 = MakeSharedProfiledLock(cs, LOCK_PROFILE_SITE("shared " #cs))
+#define SCOPED_SHAREDLOCK2(cs) auto lock2 = MakeSharedProfiledLock(cs, LOCK_PROFILE_SITE("shared " #cs))
+#else
+#define SCOPED_SHAREDLOCK(cs) auto lock = MakeSharedScopedLock(cs)
+#define SCOPED_SHAREDLOCK1(cs) auto lock1 = MakeSharedScopedLock(cs)
+#define SCOPED_SHAREDLOCK2(cs) auto lock2 = MakeSharedScopedLock(cs)
+#endif
+#define SCOPED_EXCLUSIVELOCK(cs) SCOPED_SAFELOCK(cs)
+#define SCOPED_EXCLUSIVELOCK1(cs) SCOPED_SAFELOCK1(cs)
+#define SCOPED_EXCLUSIVELOCK2(cs) SCOPED_SAFELOCK2(cs)
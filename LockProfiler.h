@@ -0,0 +1,303 @@
+/********************************************************************
+	filename: 	LockProfiler.h
+
+	purpose:	加锁点的争用统计
+	            定义LOCK_PROFILING后，SCOPED_SAFELOCK/SCOPED_SHAREDLOCK/VX_SCOPED_SAFELOCK
+	            改为带统计的守卫：每个调用点(__FILE__/__LINE__)一个静态统计对象，
+	            记录加锁次数、等待时间与持有时间，时间按2的幂分桶，全部为无锁原子计数
+	            未定义时这些宏保持原样，没有任何额外开销
+	            用法：CLockProfiler::Dump(sReport) 取得按总等待时间排序的文本报告，
+	                  CLockProfiler::Snapshot(vecStat) 取得原始数据自行上报
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include "LockHelper.h"     // LockHelper.h在LOCK_PROFILING下反过来包含本文件，由#pragma once断开循环
+
+//////////////////////////////////////////////////////////////////////////
+// 单个加锁点的统计，作为函数内静态对象存在，构造时挂到全局链表上，永不摘除
+//////////////////////////////////////////////////////////////////////////
+class CLockSite
+{
+public:
+    enum
+    {
+        BUCKETS = 32,   // 第k桶为[2^k, 2^(k+1))纳秒，最后一桶不设上限（约2秒以上）
+    };
+
+    CLockSite(const char* pszFile, int nLine, const char* pszExpr)
+        : m_pszFile(pszFile)
+        , m_nLine(nLine)
+        , m_pszExpr(pszExpr)
+        , m_uCount(0)
+        , m_uWaitNs(0)
+        , m_uHoldNs(0)
+        , m_pNext(NULL)
+    {
+        for(int i = 0; i < BUCKETS; ++i)
+        {
+            m_uWaitHist[i].store(0, std::memory_order_relaxed);
+            m_uHoldHist[i].store(0, std::memory_order_relaxed);
+        }
+        CLockSite* pHead = Head().load(std::memory_order_relaxed);
+        do
+        {
+            m_pNext = pHead;
+        } while(!Head().compare_exchange_weak(pHead, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+private: // 拒绝拷贝
+    CLockSite(const CLockSite&);
+    CLockSite& operator=(const CLockSite&);
+
+public:
+    static uint64_t NowNs()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int Bucket(uint64_t uNs)
+    {
+        int k = 0;
+        while(uNs > 1 && k < BUCKETS - 1)
+        {
+            uNs >>= 1;
+            ++k;
+        }
+        return k;
+    }
+
+    void RecordWait(uint64_t uNs)
+    {
+        m_uCount.fetch_add(1, std::memory_order_relaxed);
+        m_uWaitNs.fetch_add(uNs, std::memory_order_relaxed);
+        m_uWaitHist[Bucket(uNs)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void RecordHold(uint64_t uNs)
+    {
+        m_uHoldNs.fetch_add(uNs, std::memory_order_relaxed);
+        m_uHoldHist[Bucket(uNs)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static std::atomic<CLockSite*>& Head()
+    {
+        static std::atomic<CLockSite*> s_pHead(NULL);
+        return s_pHead;
+    }
+
+private:
+    friend class CLockProfiler;
+
+    const char*             m_pszFile;
+    int                     m_nLine;
+    const char*             m_pszExpr;          /*SCOPED_SAFELOCK的参数原文*/
+    std::atomic<uint64_t>   m_uCount;
+    std::atomic<uint64_t>   m_uWaitNs;          /*累计等待时间*/
+    std::atomic<uint64_t>   m_uHoldNs;          /*累计持有时间*/
+    std::atomic<uint64_t>   m_uWaitHist[BUCKETS];
+    std::atomic<uint64_t>   m_uHoldHist[BUCKETS];
+    CLockSite*              m_pNext;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 带统计的作用域锁，TLock为ISmartLock/ISharedLock/IXSmartLock等接口，bShared时加共享锁
+//////////////////////////////////////////////////////////////////////////
+template<class TLock, bool bShared = false>
+class CProfiledLockHelper
+{
+public:
+    CProfiledLockHelper(TLock* pLock, CLockSite& site)
+        : m_pLock(pLock)
+        , m_site(site)
+        , m_uAcquired(0)
+    {
+        if(m_pLock)
+        {
+            uint64_t uBegin = CLockSite::NowNs();
+            if constexpr (bShared)
+            {
+                m_pLock->LockShared();
+            }
+            else
+            {
+                m_pLock->Lock();
+            }
+            m_uAcquired = CLockSite::NowNs();
+            m_site.RecordWait(m_uAcquired - uBegin);
+        }
+    }
+
+    ~CProfiledLockHelper()
+    {
+        if(m_pLock)
+        {
+            m_site.RecordHold(CLockSite::NowNs() - m_uAcquired);
+            if constexpr (bShared)
+            {
+                m_pLock->UnlockShared();
+            }
+            else
+            {
+                m_pLock->Unlock();
+            }
+        }
+    }
+
+private: // 拒绝拷贝
+    CProfiledLockHelper(const CProfiledLockHelper&);
+    CProfiledLockHelper& operator=(const CProfiledLockHelper&);
+
+private:
+    TLock*      m_pLock;
+    CLockSite&  m_site;
+    uint64_t    m_uAcquired;    /*拿到锁的时刻*/
+};
+
+// 供SCOPED_SAFELOCK等宏按参数类型推导，与非统计版的MakeScopedLock接受相同的参数
+template<class T>
+inline CProfiledLockHelper<T> MakeProfiledLock(T* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<T>(pLock, site);
+}
+
+inline CProfiledLockHelper<ISmartLock> MakeProfiledLock(ISmartLock* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<ISmartLock>(pLock, site);
+}
+
+template<class T>
+inline CProfiledLockHelper<T, true> MakeSharedProfiledLock(T* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<T, true>(pLock, site);
+}
+
+inline CProfiledLockHelper<ISharedLock, true> MakeSharedProfiledLock(ISharedLock* pLock, CLockSite& site)
+{
+    return CProfiledLockHelper<ISharedLock, true>(pLock, site);
+}
+
+// 取得当前调用点的统计对象，pszExpr为报告中显示的锁表达式，同一行展开多次时各自独立
+#define LOCK_PROFILE_SITE(pszExpr) ([]() -> CLockSite& { static CLockSite s_site(__FILE__, __LINE__, pszExpr); return s_site; }())
+
+class CLockProfiler
+{
+public:
+    struct SiteStat
+    {
+        const char* pszFile;
+        int         nLine;
+        const char* pszExpr;
+        uint64_t    uCount;
+        uint64_t    uWaitNs;
+        uint64_t    uHoldNs;
+        uint64_t    uWaitHist[CLockSite::BUCKETS];
+        uint64_t    uHoldHist[CLockSite::BUCKETS];
+    };
+
+    // 所有执行过的加锁点的当前数据（各计数分别读取，并发时彼此不严格一致）
+    static void Snapshot(std::vector<SiteStat>& vecStat)
+    {
+        for(CLockSite* p = CLockSite::Head().load(std::memory_order_acquire); p; p = p->m_pNext)
+        {
+            SiteStat stat;
+            stat.pszFile = p->m_pszFile;
+            stat.nLine = p->m_nLine;
+            stat.pszExpr = p->m_pszExpr;
+            stat.uCount = p->m_uCount.load(std::memory_order_relaxed);
+            stat.uWaitNs = p->m_uWaitNs.load(std::memory_order_relaxed);
+            stat.uHoldNs = p->m_uHoldNs.load(std::memory_order_relaxed);
+            for(int i = 0; i < CLockSite::BUCKETS; ++i)
+            {
+                stat.uWaitHist[i] = p->m_uWaitHist[i].load(std::memory_order_relaxed);
+                stat.uHoldHist[i] = p->m_uHoldHist[i].load(std::memory_order_relaxed);
+            }
+            vecStat.push_back(stat);
+        }
+    }
+
+    // 清零所有计数，用于按时间段采样
+    static void Reset()
+    {
+        for(CLockSite* p = CLockSite::Head().load(std::memory_order_acquire); p; p = p->m_pNext)
+        {
+            p->m_uCount.store(0, std::memory_order_relaxed);
+            p->m_uWaitNs.store(0, std::memory_order_relaxed);
+            p->m_uHoldNs.store(0, std::memory_order_relaxed);
+            for(int i = 0; i < CLockSite::BUCKETS; ++i)
+            {
+                p->m_uWaitHist[i].store(0, std::memory_order_relaxed);
+                p->m_uHoldHist[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** @fn static uint64_t Percentile(const uint64_t* pHist, double dRatio)
+     *  @brief 由直方图估算分位数，返回所在桶的上界（纳秒）
+     */
+    static uint64_t Percentile(const uint64_t* pHist, double dRatio)
+    {
+        uint64_t uTotal = 0;
+        for(int i = 0; i < CLockSite::BUCKETS; ++i)
+        {
+            uTotal += pHist[i];
+        }
+        uint64_t uTarget = (uint64_t)(uTotal * dRatio);
+        uint64_t uSeen = 0;
+        for(int i = 0; i < CLockSite::BUCKETS; ++i)
+        {
+            uSeen += pHist[i];
+            if(uSeen > uTarget)
+            {
+                return (uint64_t)2 << i;
+            }
+        }
+        return 0;
+    }
+
+    /** @fn static void Dump(std::string& sReport, size_t nTop = 0)
+     *  @brief 生成文本报告追加到sReport，按总等待时间降序，nTop为0时输出全部
+     */
+    static void Dump(std::string& sReport, size_t nTop = 0)
+    {
+        std::vector<SiteStat> vecStat;
+        Snapshot(vecStat);
+        std::sort(vecStat.begin(), vecStat.end(), [](const SiteStat& a, const SiteStat& b)
+        {
+            return a.uWaitNs > b.uWaitNs;
+        });
+        if(nTop && vecStat.size() > nTop)
+        {
+            vecStat.resize(nTop);
+        }
+
+        char chLine[512];
+        snprintf(chLine, sizeof(chLine), "%12s %12s %10s %10s %12s %10s %10s  %s\n",
+            "count", "wait(ms)", "wait_avg", "wait_p99", "hold(ms)", "hold_avg", "hold_p99", "site");
+        sReport += chLine;
+        for(size_t i = 0; i < vecStat.size(); ++i)
+        {
+            const SiteStat& stat = vecStat[i];
+            if(0 == stat.uCount)
+            {
+                continue;
+            }
+            snprintf(chLine, sizeof(chLine), "%12llu %12.3f %8lluns %8lluns %12.3f %8lluns %8lluns  %s:%d %s\n",
+                (unsigned long long)stat.uCount,
+                stat.uWaitNs / 1e6,
+                (unsigned long long)(stat.uWaitNs / stat.uCount),
+                (unsigned long long)Percentile(stat.uWaitHist, 0.99),
+                stat.uHoldNs / 1e6,
+                (unsigned long long)(stat.uHoldNs / stat.uCount),
+                (unsigned long long)Percentile(stat.uHoldHist, 0.99),
+                stat.pszFile, stat.nLine, stat.pszExpr);
+            sReport += chLine;
+        }
+    }
+};
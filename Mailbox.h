@@ -0,0 +1,421 @@
+/********************************************************************
+	filename: 	Mailbox.h
+
+	purpose:	有界无锁多生产者单消费者邮箱，工作线程收消息用
+	            环形数组，每个槽带序号（Vyukov有界队列），生产者之间只在入队位置上CAS，
+	            消费者出队不需要原子读改写，可一次取出一批
+	            消费者只有在邮箱空、准备睡眠时才登记，生产者看到登记才唤醒，
+	            平时投递不进内核；唤醒用futex，Linux下也可改用eventfd以便挂到epoll上
+	            邮箱满时按策略处理：阻塞等空位、丢弃并计数、或立即返回失败
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <new>
+#include <utility>
+#include <vector>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "FutexLock.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+template<class T>
+class CMailbox
+{
+public:
+    enum FullPolicy
+    {
+        FULL_BLOCK,     // 阻塞直到有空位或邮箱关闭
+        FULL_DROP,      // 丢弃本条，计入DroppedCount()
+        FULL_FAIL,      // 立即返回失败，由调用方处理
+    };
+
+    /** @fn CMailbox(size_t nCapacity, FullPolicy ePolicy = FULL_BLOCK, bool bEventFd = false)
+     *  @param (IN) size_t nCapacity 容量，向上取整到2的幂
+     *  @param (IN) bool bEventFd 为true时用eventfd通知消费者（仅Linux），可把GetEventFd()挂到epoll上
+     */
+    explicit CMailbox(size_t nCapacity, FullPolicy ePolicy = FULL_BLOCK, bool bEventFd = false)
+        : m_pSlots(NULL)
+        , m_uMask(0)
+        , m_ePolicy(ePolicy)
+        , m_nEventFd(-1)
+        , m_uEnqueuePos(0)
+        , m_uDequeuePos(0)
+        , m_uArmed(0)
+        , m_uItemSeq(0)
+        , m_uClosed(0)
+        , m_uInterrupted(0)
+        , m_uBlockedProducers(0)
+        , m_uSpaceSeq(0)
+        , m_uDropped(0)
+    {
+        size_t uSize = 2;
+        while(uSize < nCapacity)
+        {
+            uSize <<= 1;
+        }
+        m_uMask = uSize - 1;
+        m_pSlots = new Slot[uSize];
+        for(size_t i = 0; i < uSize; ++i)
+        {
+            m_pSlots[i].uSeq.store(i, std::memory_order_relaxed);
+        }
+#ifdef __linux__
+        if(bEventFd)
+        {
+            m_nEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+#else
+        (void)bEventFd;
+#endif
+    }
+
+    ~CMailbox()
+    {
+        size_t uPos = m_uDequeuePos.load(std::memory_order_relaxed);
+        while(m_pSlots[uPos & m_uMask].uSeq.load(std::memory_order_acquire) == uPos + 1)
+        {
+            m_pSlots[uPos & m_uMask].Value()->~T();
+            ++uPos;
+        }
+        delete[] m_pSlots;
+#ifdef __linux__
+        if(m_nEventFd >= 0)
+        {
+            close(m_nEventFd);
+        }
+#endif
+    }
+
+private: // 拒绝拷贝
+    CMailbox(const CMailbox&);
+    CMailbox& operator=(const CMailbox&);
+
+public:
+    //////////////////////////////////////////////////////////////////////////
+    // 生产者接口，任意线程可调用
+    //////////////////////////////////////////////////////////////////////////
+
+    // 投递一条消息，按构造时的策略处理邮箱满；邮箱已关闭时返回false
+    bool Post(T&& msg)
+    {
+        return Post(std::move(msg), m_ePolicy);
+    }
+
+    bool Post(const T& msg)
+    {
+        T tmp(msg);
+        return Post(std::move(tmp), m_ePolicy);
+    }
+
+    // 指定本次的满策略；失败时msg保持原样
+    bool Post(T&& msg, FullPolicy ePolicy)
+    {
+        if(m_uClosed.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        if(TryPush(msg))
+        {
+            return true;
+        }
+        switch(ePolicy)
+        {
+        case FULL_DROP:
+            m_uDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        case FULL_FAIL:
+            return false;
+        default:
+            return PushBlocking(msg);
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 消费者接口，只能由同一个线程调用
+    //////////////////////////////////////////////////////////////////////////
+
+    bool TryPop(T& msg)
+    {
+        size_t uPos = m_uDequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = m_pSlots[uPos & m_uMask];
+        if(slot.uSeq.load(std::memory_order_acquire) != uPos + 1)
+        {
+            return false;   // 空，或生产者已占位但尚未写完
+        }
+        T* pValue = slot.Value();
+        msg = std::move(*pValue);
+        pValue->~T();
+        slot.uSeq.store(uPos + m_uMask + 1, std::memory_order_release);
+        m_uDequeuePos.store(uPos + 1, std::memory_order_relaxed);
+        WakeProducers();
+        return true;
+    }
+
+    /** @fn size_t PopBatch(std::vector<T>& vecOut, size_t nMax = (size_t)-1)
+     *  @brief 取出至多nMax条追加到vecOut，不阻塞
+     *  @return size_t 取出的条数
+     */
+    size_t PopBatch(std::vector<T>& vecOut, size_t nMax = (size_t)-1)
+    {
+        size_t uPos = m_uDequeuePos.load(std::memory_order_relaxed);
+        size_t nCount = 0;
+        while(nCount < nMax)
+        {
+            Slot& slot = m_pSlots[uPos & m_uMask];
+            if(slot.uSeq.load(std::memory_order_acquire) != uPos + 1)
+            {
+                break;
+            }
+            T* pValue = slot.Value();
+            vecOut.push_back(std::move(*pValue));
+            pValue->~T();
+            slot.uSeq.store(uPos + m_uMask + 1, std::memory_order_release);
+            ++uPos;
+            ++nCount;
+        }
+        if(nCount)
+        {
+            m_uDequeuePos.store(uPos, std::memory_order_relaxed);
+            WakeProducers();
+        }
+        return nCount;
+    }
+
+    /** @fn bool Wait(uint32_t uTimeoutMs = (uint32_t)-1)
+     *  @brief 邮箱空时睡眠，直到有消息、Interrupt()/Close()或超时
+     *    Interrupt()发生在Wait()之前也有效：下一次Wait()立即返回
+     *  @return bool 有消息可取时返回true
+     */
+    bool Wait(uint32_t uTimeoutMs = (uint32_t)-1)
+    {
+        uint32_t uSeq = m_uItemSeq.load(std::memory_order_acquire);
+        if(Arm())
+        {
+            if(m_nEventFd >= 0)
+            {
+#ifdef __linux__
+                struct pollfd pfd;
+                pfd.fd = m_nEventFd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                poll(&pfd, 1, (uTimeoutMs == (uint32_t)-1) ? -1 : (int)uTimeoutMs);
+                DrainEventFd();
+#endif
+            }
+            else
+            {
+                LockDetail::FutexWait(&m_uItemSeq, uSeq, uTimeoutMs);
+            }
+        }
+        Disarm();
+        m_uInterrupted.store(0, std::memory_order_relaxed);
+        return !IsEmpty();
+    }
+
+    /** @fn bool Arm()
+     *  @brief 声明消费者将要睡眠，此后的第一条投递会发出通知
+     *    自行在epoll上等待GetEventFd()时，在epoll_wait前调用；返回false表示已有消息，不应睡眠
+     */
+    bool Arm()
+    {
+        m_uArmed.store(1, std::memory_order_relaxed);
+        // 与生产者“写入槽位、再检查登记”配对，两边至少有一方看到对方
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return IsEmpty() && !m_uClosed.load(std::memory_order_relaxed) && !m_uInterrupted.load(std::memory_order_relaxed);
+    }
+
+    void Disarm()
+    {
+        m_uArmed.store(0, std::memory_order_relaxed);
+    }
+
+    // 读空eventfd的计数，被eventfd唤醒后调用
+    void DrainEventFd()
+    {
+#ifdef __linux__
+        uint64_t uValue = 0;
+        if(m_nEventFd >= 0 && read(m_nEventFd, &uValue, sizeof(uValue)) < 0)
+        {
+            // EAGAIN：已被读空
+        }
+#endif
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 其他
+    //////////////////////////////////////////////////////////////////////////
+
+    // 唤醒正在或即将Wait()的消费者，不影响投递
+    void Interrupt()
+    {
+        m_uInterrupted.store(1, std::memory_order_seq_cst);
+        m_uArmed.store(0, std::memory_order_relaxed);
+        Notify();
+    }
+
+    // 关闭后投递一律失败，阻塞的生产者和睡眠的消费者都被唤醒；已入队的消息仍可取出
+    void Close()
+    {
+        m_uClosed.store(1, std::memory_order_seq_cst);
+        Interrupt();
+        m_uSpaceSeq.fetch_add(1);
+        LockDetail::FutexWake(&m_uSpaceSeq, INT_MAX);
+    }
+
+    bool IsClosed() const
+    {
+        return 0 != m_uClosed.load(std::memory_order_relaxed);
+    }
+
+    bool IsEmpty() const
+    {
+        size_t uPos = m_uDequeuePos.load(std::memory_order_relaxed);
+        return m_pSlots[uPos & m_uMask].uSeq.load(std::memory_order_acquire) != uPos + 1;
+    }
+
+    // 近似的当前条数
+    size_t Size() const
+    {
+        size_t uEnq = m_uEnqueuePos.load(std::memory_order_relaxed);
+        size_t uDeq = m_uDequeuePos.load(std::memory_order_relaxed);
+        return (uEnq > uDeq) ? uEnq - uDeq : 0;
+    }
+
+    size_t Capacity() const
+    {
+        return m_uMask + 1;
+    }
+
+    uint64_t DroppedCount() const
+    {
+        return m_uDropped.load(std::memory_order_relaxed);
+    }
+
+    int GetEventFd() const
+    {
+        return m_nEventFd;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t>     uSeq;   /*等于位置号：空闲可写；位置号+1：已写入可读*/
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* Value()
+        {
+            return reinterpret_cast<T*>(storage);
+        }
+    };
+
+    // 满时返回false且不动msg
+    bool TryPush(T& msg)
+    {
+        size_t uPos = m_uEnqueuePos.load(std::memory_order_relaxed);
+        Slot* pSlot = NULL;
+        while(true)
+        {
+            pSlot = &m_pSlots[uPos & m_uMask];
+            size_t uSeq = pSlot->uSeq.load(std::memory_order_acquire);
+            intptr_t nDiff = (intptr_t)uSeq - (intptr_t)uPos;
+            if(0 == nDiff)
+            {
+                if(m_uEnqueuePos.compare_exchange_weak(uPos, uPos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if(nDiff < 0)
+            {
+                return false;   // 该槽还是一圈之前的消息，满
+            }
+            else
+            {
+                uPos = m_uEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        new (pSlot->storage) T(std::move(msg));
+        pSlot->uSeq.store(uPos + 1, std::memory_order_release);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_uArmed.load(std::memory_order_relaxed) && m_uArmed.exchange(0, std::memory_order_relaxed))
+        {
+            Notify();
+        }
+        return true;
+    }
+
+    bool PushBlocking(T& msg)
+    {
+        while(true)
+        {
+            uint32_t uSeq = m_uSpaceSeq.load(std::memory_order_acquire);
+            m_uBlockedProducers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(TryPush(msg))
+            {
+                m_uBlockedProducers.fetch_sub(1);
+                return true;
+            }
+            if(m_uClosed.load(std::memory_order_relaxed))
+            {
+                m_uBlockedProducers.fetch_sub(1);
+                return false;
+            }
+            LockDetail::FutexWait(&m_uSpaceSeq, uSeq);
+            m_uBlockedProducers.fetch_sub(1);
+        }
+    }
+
+    // 消费者腾出空位后调用，只有确实有生产者阻塞时才进内核
+    void WakeProducers()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_uBlockedProducers.load(std::memory_order_relaxed))
+        {
+            m_uSpaceSeq.fetch_add(1);
+            LockDetail::FutexWake(&m_uSpaceSeq, INT_MAX);
+        }
+    }
+
+    void Notify()
+    {
+        if(m_nEventFd >= 0)
+        {
+#ifdef __linux__
+            uint64_t uOne = 1;
+            if(write(m_nEventFd, &uOne, sizeof(uOne)) < 0)
+            {
+                // EAGAIN：计数已满，消费者必然会被唤醒
+            }
+#endif
+        }
+        else
+        {
+            m_uItemSeq.fetch_add(1, std::memory_order_release);
+            LockDetail::FutexWake(&m_uItemSeq, 1);
+        }
+    }
+
+private:
+    Slot*                               m_pSlots;
+    size_t                              m_uMask;
+    FullPolicy                          m_ePolicy;
+    int                                 m_nEventFd;
+
+    alignas(64) std::atomic<size_t>     m_uEnqueuePos;      /*生产者共享*/
+    alignas(64) std::atomic<size_t>     m_uDequeuePos;      /*只有消费者写*/
+    alignas(64) std::atomic<uint32_t>   m_uArmed;           /*消费者已准备睡眠*/
+    std::atomic<uint32_t>               m_uItemSeq;         /*消费者的futex字*/
+    std::atomic<uint32_t>               m_uClosed;
+    std::atomic<uint32_t>               m_uInterrupted;
+    alignas(64) std::atomic<uint32_t>   m_uBlockedProducers;
+    std::atomic<uint32_t>               m_uSpaceSeq;        /*阻塞生产者的futex字*/
+    std::atomic<uint64_t>               m_uDropped;
+};
@@ -0,0 +1,106 @@
+/********************************************************************
+	filename: 	MailboxThread.h
+
+	purpose:	带邮箱的工作线程：替代PostThreadMessage/SurePostMessage的线程消息队列
+	            每个线程独占一个有界CMailbox，任意线程PostMsg投递，
+	            工作线程成批取出后交给OnMessages/OnMessage处理，邮箱满时按策略处理，不再Sleep重试
+	            派生类须在自己的析构函数里先调用StopAndWait()，以免线程还在调用已析构的OnMessage
+*********************************************************************/
+#pragma once
+#include <vector>
+#include "WorkThreadBase.h"
+#include "Mailbox.h"
+
+template<class TMsg>
+class CMailboxThread : public CWorkThreadBase
+{
+public:
+    enum
+    {
+        BATCH_SIZE = 64,    // 每批最多取出的消息数
+    };
+
+    typedef CMailbox<TMsg> MailboxType;
+
+    /** @fn CMailboxThread(size_t nCapacity = 4096, typename MailboxType::FullPolicy ePolicy = MailboxType::FULL_BLOCK, uint32_t uIdleMs = (uint32_t)-1)
+     *  @param (IN) size_t nCapacity 邮箱容量
+     *  @param (IN) FullPolicy ePolicy 邮箱满时的默认策略
+     *  @param (IN) uint32_t uIdleMs 空闲超过此时间调用一次OnIdle()，默认不调用
+     */
+    explicit CMailboxThread(size_t nCapacity = 4096,
+        typename MailboxType::FullPolicy ePolicy = MailboxType::FULL_BLOCK,
+        uint32_t uIdleMs = (uint32_t)-1)
+        : m_mailbox(nCapacity, ePolicy)
+        , m_uIdleMs(uIdleMs)
+        , m_stopCallback(GetStopToken(), [this]() { m_mailbox.Interrupt(); })
+    {
+    }
+
+    virtual ~CMailboxThread()
+    {
+        StopAndWait();
+    }
+
+public:
+    bool PostMsg(TMsg&& msg)
+    {
+        return m_mailbox.Post(std::move(msg));
+    }
+
+    bool PostMsg(const TMsg& msg)
+    {
+        return m_mailbox.Post(msg);
+    }
+
+    // 本次投递指定满策略，如平时阻塞、关键路径上改为失败即返回
+    bool PostMsg(TMsg&& msg, typename MailboxType::FullPolicy ePolicy)
+    {
+        return m_mailbox.Post(std::move(msg), ePolicy);
+    }
+
+    MailboxType& GetMailbox()
+    {
+        return m_mailbox;
+    }
+
+protected:
+    virtual void DoWork()
+    {
+        std::vector<TMsg> vecBatch;
+        vecBatch.reserve(BATCH_SIZE);
+        while(IsThrdRunning())
+        {
+            if(0 == m_mailbox.PopBatch(vecBatch, BATCH_SIZE))
+            {
+                if(!m_mailbox.Wait(m_uIdleMs) && IsThrdRunning())
+                {
+                    OnIdle();
+                }
+                continue;
+            }
+            OnMessages(vecBatch);
+            vecBatch.clear();
+        }
+    }
+
+    // 处理一批消息，默认逐条调用OnMessage；需要合并处理（如批量写库）时重载
+    virtual void OnMessages(std::vector<TMsg>& vecBatch)
+    {
+        for(size_t i = 0; i < vecBatch.size(); ++i)
+        {
+            OnMessage(vecBatch[i]);
+        }
+    }
+
+    virtual void OnMessage(TMsg& msg) = 0;
+
+    // 空闲超时（或被Interrupt唤醒而无消息）时调用
+    virtual void OnIdle()
+    {
+    }
+
+protected:
+    MailboxType     m_mailbox;
+    uint32_t        m_uIdleMs;
+    CStopCallback   m_stopCallback;     /*停止请求时打断邮箱上的等待*/
+};
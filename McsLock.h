@@ -0,0 +1,203 @@
+/********************************************************************
+	filename: 	McsLock.h
+
+	purpose:	MCS排队锁，多核高争用下的公平互斥锁
+	            等待者按到达顺序排成链表，每个等待者只在自己的节点（独占缓存行）上自旋，
+	            释放时只写后继一个节点，锁所在缓存行不会在所有等待核之间来回失效
+	            严格先进先出，不会饿死；代价是无竞争时比CFutexLock多一次原子交换，
+	            且后继若已挂起，交接要多一次唤醒，临界区很短、线程数不多时CFutexLock更快
+	            节点取自线程局部的节点池，同一线程可同时持有多把MCS锁；不可重入，须由加锁的线程解锁
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include "LockHelper.h"
+#include "FutexLock.h"
+
+namespace LockDetail
+{
+    // 一个等待者在一把锁上的排队节点
+    struct alignas(64) CMcsNode
+    {
+        enum : uint32_t
+        {
+            WAITING = 0,
+            PARKED  = 1,    // 自旋超时，已挂起或即将挂起在uState上
+            GRANTED = 2,
+        };
+
+        std::atomic<CMcsNode*>  pNext;
+        std::atomic<uint32_t>   uState;
+        CMcsNode*               pFreeNext;  /*线程局部空闲链表*/
+    };
+
+    // 线程局部节点池，线程退出时节点都已不在任何队列中，可直接释放
+    class CMcsNodePool
+    {
+    public:
+        enum
+        {
+            PRESET_NODES = 8,   // 同时持有的MCS锁超过此数才从堆上分配
+        };
+
+        CMcsNodePool()
+            : m_pFree(NULL)
+        {
+            for(int i = 0; i < PRESET_NODES; ++i)
+            {
+                Put(&m_nodes[i]);
+            }
+        }
+
+        ~CMcsNodePool()
+        {
+            while(m_pFree)
+            {
+                CMcsNode* pNode = m_pFree;
+                m_pFree = pNode->pFreeNext;
+                if(pNode < m_nodes || pNode >= m_nodes + PRESET_NODES)
+                {
+                    delete pNode;
+                }
+            }
+        }
+
+    private: // 拒绝拷贝
+        CMcsNodePool(const CMcsNodePool&);
+        CMcsNodePool& operator=(const CMcsNodePool&);
+
+    public:
+        static CMcsNodePool& Local()
+        {
+            static thread_local CMcsNodePool s_pool;
+            return s_pool;
+        }
+
+        CMcsNode* Get()
+        {
+            CMcsNode* pNode = m_pFree;
+            if(pNode)
+            {
+                m_pFree = pNode->pFreeNext;
+            }
+            else
+            {
+                pNode = new CMcsNode;
+            }
+            return pNode;
+        }
+
+        void Put(CMcsNode* pNode)
+        {
+            pNode->pFreeNext = m_pFree;
+            m_pFree = pNode;
+        }
+
+    private:
+        CMcsNode    m_nodes[PRESET_NODES];
+        CMcsNode*   m_pFree;
+    };
+}
+
+class CMcsLock final : public ISmartLock
+{
+public:
+    enum
+    {
+        SPIN_COUNT = 1000,  // 在自己节点上自旋的次数，超过后挂起
+    };
+
+    CMcsLock()
+        : m_pTail(NULL)
+        , m_pHolder(NULL)
+    {
+    }
+
+private: // 拒绝拷贝
+    CMcsLock(const CMcsLock&);
+    CMcsLock& operator=(const CMcsLock&);
+
+public:
+    void Lock()
+    {
+        LockDetail::CMcsNode* pNode = LockDetail::CMcsNodePool::Local().Get();
+        pNode->pNext.store(NULL, std::memory_order_relaxed);
+        pNode->uState.store(LockDetail::CMcsNode::WAITING, std::memory_order_relaxed);
+
+        LockDetail::CMcsNode* pPrev = m_pTail.exchange(pNode, std::memory_order_acq_rel);
+        if(pPrev)
+        {
+            pPrev->pNext.store(pNode, std::memory_order_release);
+            WaitGranted(pNode);
+        }
+        m_pHolder = pNode;
+    }
+
+    void Unlock()
+    {
+        LockDetail::CMcsNode* pNode = m_pHolder;
+        LockDetail::CMcsNode* pNext = pNode->pNext.load(std::memory_order_acquire);
+        if(NULL == pNext)
+        {
+            // 没有后继则把队尾摘空；失败说明有人刚换上队尾、还没来得及挂到本节点后面
+            LockDetail::CMcsNode* pExpected = pNode;
+            if(m_pTail.compare_exchange_strong(pExpected, NULL, std::memory_order_release, std::memory_order_relaxed))
+            {
+                LockDetail::CMcsNodePool::Local().Put(pNode);
+                return;
+            }
+            while(NULL == (pNext = pNode->pNext.load(std::memory_order_acquire)))
+            {
+                LockDetail::CpuRelax();
+            }
+        }
+
+        // 交出锁之后后继随时可能解锁并改写m_pHolder，不能再访问本锁的成员
+        if(LockDetail::CMcsNode::PARKED == pNext->uState.exchange(LockDetail::CMcsNode::GRANTED, std::memory_order_release))
+        {
+            LockDetail::FutexWake(&pNext->uState, 1);
+        }
+        LockDetail::CMcsNodePool::Local().Put(pNode);
+    }
+
+    bool TryLock()
+    {
+        LockDetail::CMcsNode* pNode = LockDetail::CMcsNodePool::Local().Get();
+        pNode->pNext.store(NULL, std::memory_order_relaxed);
+        LockDetail::CMcsNode* pExpected = NULL;
+        if(m_pTail.compare_exchange_strong(pExpected, pNode, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            m_pHolder = pNode;
+            return true;
+        }
+        LockDetail::CMcsNodePool::Local().Put(pNode);
+        return false;
+    }
+
+private:
+    static void WaitGranted(LockDetail::CMcsNode* pNode)
+    {
+        for(int nSpin = 0; nSpin < SPIN_COUNT; ++nSpin)
+        {
+            if(LockDetail::CMcsNode::GRANTED == pNode->uState.load(std::memory_order_acquire))
+            {
+                return;
+            }
+            LockDetail::CpuRelax();
+        }
+
+        uint32_t uState = LockDetail::CMcsNode::WAITING;
+        if(!pNode->uState.compare_exchange_strong(uState, LockDetail::CMcsNode::PARKED, std::memory_order_acquire))
+        {
+            return;     // 恰好在此时被授予
+        }
+        while(pNode->uState.load(std::memory_order_acquire) != LockDetail::CMcsNode::GRANTED)
+        {
+            LockDetail::FutexWait(&pNode->uState, LockDetail::CMcsNode::PARKED);
+        }
+    }
+
+private:
+    std::atomic<LockDetail::CMcsNode*>  m_pTail;
+    LockDetail::CMcsNode*               m_pHolder;  /*持有者的节点，只由持有者读写*/
+};
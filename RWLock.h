@@ -0,0 +1,132 @@
+/********************************************************************
+	filename: 	RWLock.h
+
+	purpose:	写优先的读写锁，用于读多写少的表（配置、回调映射等）
+	            读者之间不互斥；一旦有写者在等，新来的读者让路，写者不会被读者饿死
+	            无竞争的读加锁/解锁各一次原子操作，等待时先短暂自旋再挂起到futex上
+	            不可重入：持有读锁时再加读锁，若中间有写者排队会死锁
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <limits.h>
+#include <stdint.h>
+#include "LockHelper.h"
+#include "FutexLock.h"
+
+class CRWLock final : public ISharedLock
+{
+public:
+    enum
+    {
+        SPIN_COUNT = 64,    // 挂起前的自旋次数
+    };
+
+    CRWLock()
+        : m_uState(0)
+        , m_uWaitingWriters(0)
+        , m_uReaderSeq(0)
+        , m_uWriterSeq(0)
+    {
+    }
+
+private: // 拒绝拷贝
+    CRWLock(const CRWLock&);
+    CRWLock& operator=(const CRWLock&);
+
+public:
+    // 独占（写）加锁
+    void Lock()
+    {
+        m_uWaitingWriters.fetch_add(1);
+        for(int nSpin = 0; ; ++nSpin)
+        {
+            uint32_t uState = 0;
+            if(m_uState.compare_exchange_weak(uState, WRITER))
+            {
+                break;
+            }
+            if(nSpin < SPIN_COUNT)
+            {
+                LockDetail::CpuRelax();
+                continue;
+            }
+            // 先取序号再复查条件，之后的唤醒都会改变序号，不会丢失
+            uint32_t uSeq = m_uWriterSeq.load();
+            if(m_uState.load() != 0)
+            {
+                LockDetail::FutexWait(&m_uWriterSeq, uSeq);
+            }
+        }
+        m_uWaitingWriters.fetch_sub(1);
+    }
+
+    void Unlock()
+    {
+        m_uState.store(0);
+        WakeWaiters();
+    }
+
+    // 共享（读）加锁，有写者持有或排队时等待
+    void LockShared()
+    {
+        for(int nSpin = 0; ; ++nSpin)
+        {
+            if(0 == m_uWaitingWriters.load())
+            {
+                uint32_t uState = m_uState.load();
+                if(!(uState & WRITER) && m_uState.compare_exchange_weak(uState, uState + 1))
+                {
+                    return;
+                }
+            }
+            if(nSpin < SPIN_COUNT)
+            {
+                LockDetail::CpuRelax();
+                continue;
+            }
+            uint32_t uSeq = m_uReaderSeq.load();
+            if(m_uWaitingWriters.load() != 0 || (m_uState.load() & WRITER))
+            {
+                LockDetail::FutexWait(&m_uReaderSeq, uSeq);
+            }
+        }
+    }
+
+    void UnlockShared()
+    {
+        // 最后一个读者离开时唤醒排队的写者
+        if(1 == m_uState.fetch_sub(1) && m_uWaitingWriters.load() != 0)
+        {
+            m_uWriterSeq.fetch_add(1);
+            LockDetail::FutexWake(&m_uWriterSeq, 1);
+        }
+    }
+
+private:
+    // 写者解锁：有写者排队时只交给下一个写者，否则放行全部读者
+    void WakeWaiters()
+    {
+        if(m_uWaitingWriters.load() != 0)
+        {
+            m_uWriterSeq.fetch_add(1);
+            LockDetail::FutexWake(&m_uWriterSeq, 1);
+        }
+        else
+        {
+            m_uReaderSeq.fetch_add(1);
+            LockDetail::FutexWake(&m_uReaderSeq, INT_MAX);
+        }
+    }
+
+private:
+    enum : uint32_t
+    {
+        WRITER = 0x80000000u,   // 写者持有；低31位为持有读锁的读者数
+    };
+
+    // 互斥由m_uState上的CAS保证；写者登记与读者检查登记之间需要全序，均用默认的顺序一致操作
+    std::atomic<uint32_t>   m_uState;
+    std::atomic<uint32_t>   m_uWaitingWriters;  /*已登记、尚未拿到锁的写者数*/
+    std::atomic<uint32_t>   m_uReaderSeq;       /*读者挂起/唤醒用的序号*/
+    std::atomic<uint32_t>   m_uWriterSeq;       /*写者挂起/唤醒用的序号*/
+};
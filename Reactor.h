@@ -0,0 +1,440 @@
+/********************************************************************
+	filename: 	Reactor.h
+
+	purpose:	基于epoll的事件驱动工作线程，一个线程服务成千上万个连接、管道
+	            fd一律按边沿触发(EPOLLET)登记，处理函数须把数据读/写到EAGAIN为止，fd须为非阻塞
+	            一次epoll_wait至多取MAX_EVENTS个就绪事件，成批分派；
+	            定时器用CTimingWheel，到期回调与fd事件在同一线程执行，epoll_wait的超时即到下一个定时器的时间；
+	            其他线程经Post投递任务到本线程执行，任务邮箱用eventfd通知，同样挂在epoll上，
+	            邮箱只在本线程即将睡眠时才登记唤醒，平时投递不进内核
+	            AddFd/RemoveFd/定时器接口可在任意线程调用；在其他线程RemoveFd返回时，
+	            处理函数可能仍在执行中，需要同步摘除（如摘除后立即close）时用Post在本线程内进行
+*********************************************************************/
+#pragma once
+#ifndef __linux__
+#error "Reactor.h: Linux only"
+#endif
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <limits.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "WorkThreadBase.h"
+#include "Mailbox.h"
+#include "TimerWheel.h"
+#include "FutexLock.h"
+
+#ifndef NO_XLOGGING
+#include "Logging.h"
+#endif
+
+class CReactor : public CWorkThreadBase
+{
+public:
+    enum
+    {
+        MAX_EVENTS = 256,   // 每次epoll_wait最多取出的就绪事件数
+        TASK_BATCH = 64,    // 每批从邮箱取出的任务数
+    };
+
+    // 就绪回调，uEvents为epoll事件位（EPOLLIN/EPOLLOUT/EPOLLERR/EPOLLHUP等）
+    typedef std::function<void(int nFd, uint32_t uEvents)> FdHandler;
+
+    /** @fn CReactor(uint32_t uTickMs = 1, size_t nTaskCapacity = 4096)
+     *  @param (IN) uint32_t uTickMs 定时器刻度长度，即定时精度
+     *  @param (IN) size_t nTaskCapacity 跨线程任务邮箱容量，满时Post阻塞
+     */
+    explicit CReactor(uint32_t uTickMs = 1, size_t nTaskCapacity = 4096)
+        : m_nEpollFd(-1)
+        , m_uTickMs(uTickMs ? uTickMs : 1)
+        , m_tpStart(std::chrono::steady_clock::now())
+        , m_tasks(nTaskCapacity, CMailbox<std::function<void()> >::FULL_BLOCK, true)
+        , m_stopCallback(GetStopToken(), [this]() { Wake(); })
+    {
+        SetThreadName("reactor");
+        m_nEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(m_nEpollFd < 0 || m_tasks.GetEventFd() < 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_ERROR << "Failed to create epoll/eventfd. errno = " << errno;
+#endif
+            return;
+        }
+
+        // 任务邮箱的eventfd用水平触发，没读空之前每次epoll_wait都会返回，不会丢唤醒
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKE_TAG;
+        if(epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, m_tasks.GetEventFd(), &ev) != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_ERROR << "Failed to add eventfd to epoll. errno = " << errno;
+#endif
+            close(m_nEpollFd);
+            m_nEpollFd = -1;
+        }
+    }
+
+    virtual ~CReactor()
+    {
+        StopAndWait();
+        if(m_nEpollFd >= 0)
+        {
+            close(m_nEpollFd);
+            m_nEpollFd = -1;
+        }
+    }
+
+public:
+    void Start()
+    {
+        Run();
+    }
+
+    /** @fn bool Shutdown(uint32_t uTimeoutMs = (uint32_t)-1)
+     *  @brief 停止反应器线程，默认等到线程退出；滚动重启等需要限时返回的场合传入超时
+     *  @return bool 线程已退出返回true；超时返回false，线程仍归本对象所有，析构时会等它退出
+     */
+    bool Shutdown(uint32_t uTimeoutMs = (uint32_t)-1)
+    {
+        return StopFor(uTimeoutMs);
+    }
+
+    bool IsValid() const
+    {
+        return m_nEpollFd >= 0;
+    }
+
+    // 调用线程是否就是本反应器的线程
+    bool IsInReactorThread() const
+    {
+        return Current() == this;
+    }
+
+    // 置为非阻塞，边沿触发要求
+    static bool SetNonBlocking(int nFd)
+    {
+        int nFlags = fcntl(nFd, F_GETFL, 0);
+        return nFlags >= 0 && 0 == fcntl(nFd, F_SETFL, nFlags | O_NONBLOCK);
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // fd
+    //////////////////////////////////////////////////////////////////////////
+
+    /** @fn bool AddFd(int nFd, uint32_t uEvents, FdHandler fn)
+     *  @brief 登记fd，就绪时在反应器线程调用fn；同一fd未RemoveFd前不能重复登记
+     *  @param (IN) uint32_t uEvents 关心的事件，如EPOLLIN | EPOLLOUT，自动加上EPOLLET
+     */
+    bool AddFd(int nFd, uint32_t uEvents, FdHandler fn)
+    {
+        if(nFd < 0 || !fn)
+        {
+            return false;
+        }
+
+        SCOPED_SAFELOCK(&m_lock);
+        if((size_t)nFd >= m_vecEntries.size())
+        {
+            m_vecEntries.resize((size_t)nFd + 1);
+        }
+        FdEntry& entry = m_vecEntries[nFd];
+        if(entry.spHandler)
+        {
+            return false;
+        }
+
+        // 代号随每次登记递增，已摘除的fd残留在本批里的事件据此丢弃，不会错派给复用了该fd号的新登记
+        ++entry.uGen;
+        struct epoll_event ev;
+        ev.events = uEvents | EPOLLET;
+        ev.data.u64 = ((uint64_t)entry.uGen << 32) | (uint32_t)nFd;
+        if(epoll_ctl(m_nEpollFd, EPOLL_CTL_ADD, nFd, &ev) != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_WARN << "epoll_ctl add failed. fd = " << nFd << " errno = " << errno;
+#endif
+            return false;
+        }
+        entry.spHandler = std::make_shared<FdHandler>(std::move(fn));
+        return true;
+    }
+
+    // 修改关心的事件，仍为边沿触发
+    bool ModifyFd(int nFd, uint32_t uEvents)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        if(nFd < 0 || (size_t)nFd >= m_vecEntries.size() || !m_vecEntries[nFd].spHandler)
+        {
+            return false;
+        }
+
+        struct epoll_event ev;
+        ev.events = uEvents | EPOLLET;
+        ev.data.u64 = ((uint64_t)m_vecEntries[nFd].uGen << 32) | (uint32_t)nFd;
+        return 0 == epoll_ctl(m_nEpollFd, EPOLL_CTL_MOD, nFd, &ev);
+    }
+
+    // 摘除fd，不关闭它；须在close之前调用
+    bool RemoveFd(int nFd)
+    {
+        std::shared_ptr<FdHandler> spHandler;   /*在锁外析构，处理函数捕获的对象析构时可能再调本类接口*/
+        {
+            SCOPED_SAFELOCK(&m_lock);
+            if(nFd < 0 || (size_t)nFd >= m_vecEntries.size() || !m_vecEntries[nFd].spHandler)
+            {
+                return false;
+            }
+            epoll_ctl(m_nEpollFd, EPOLL_CTL_DEL, nFd, NULL);
+            spHandler.swap(m_vecEntries[nFd].spHandler);
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 跨线程任务
+    //////////////////////////////////////////////////////////////////////////
+
+    /** @fn bool Post(std::function<void()> fn)
+     *  @brief 在反应器线程执行fn；在反应器线程内调用时排到本轮之后，不经邮箱
+     *  @return bool 邮箱已关闭时返回false
+     */
+    bool Post(std::function<void()> fn)
+    {
+        if(!fn)
+        {
+            return false;
+        }
+        if(IsInReactorThread())
+        {
+            m_vecLocalTasks.push_back(std::move(fn));
+            return true;
+        }
+        return m_tasks.Post(std::move(fn));
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 定时器，回调在反应器线程执行
+    //////////////////////////////////////////////////////////////////////////
+
+    // 延迟uDelayMs毫秒执行一次
+    TimerId AddTimer(uint32_t uDelayMs, std::function<void()> fn)
+    {
+        return AddTimerImpl(uDelayMs, 0, std::move(fn));
+    }
+
+    // 延迟uDelayMs毫秒后首次执行，此后每uPeriodMs毫秒执行一次
+    TimerId AddPeriodic(uint32_t uDelayMs, uint32_t uPeriodMs, std::function<void()> fn)
+    {
+        return AddTimerImpl(uDelayMs, uPeriodMs ? uPeriodMs : 1, std::move(fn));
+    }
+
+    bool CancelTimer(TimerId id)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        return m_wheel.Cancel(id);
+    }
+
+protected:
+    virtual void DoWork()
+    {
+        Current() = this;
+
+        std::vector<struct epoll_event> vecEvents(MAX_EVENTS);
+        std::vector<std::function<void()> > vecTasks;
+        std::vector<std::function<void()> > vecFired;
+        vecTasks.reserve(TASK_BATCH);
+        while(IsThrdRunning())
+        {
+            RunTasks(vecTasks);
+            int nTimeoutMs = RunTimers(vecFired);
+
+            // 先登记再检查：登记之后的投递必然写eventfd，epoll_wait不会睡过头
+            if(!m_vecLocalTasks.empty() || !m_tasks.Arm() || !IsThrdRunning())
+            {
+                nTimeoutMs = 0;
+            }
+            int nCount = epoll_wait(m_nEpollFd, &vecEvents[0], MAX_EVENTS, nTimeoutMs);
+            m_tasks.Disarm();
+            if(nCount < 0)
+            {
+                if(errno != EINTR)
+                {
+#ifndef NO_XLOGGING
+                    LOG_ERROR << "epoll_wait failed. errno = " << errno;
+#endif
+                    SleepFor(10);
+                }
+                continue;
+            }
+            DispatchEvents(&vecEvents[0], nCount);
+        }
+
+        Current() = NULL;
+    }
+
+private:
+    enum : uint64_t
+    {
+        WAKE_TAG = ~(uint64_t)0,    // 任务邮箱eventfd的epoll数据
+    };
+
+    struct FdEntry
+    {
+        FdEntry()
+            : uGen(0)
+        {
+        }
+
+        uint32_t                    uGen;
+        std::shared_ptr<FdHandler>  spHandler;  /*为空表示未登记*/
+    };
+
+    static CReactor*& Current()
+    {
+        static thread_local CReactor* s_pCurrent = NULL;
+        return s_pCurrent;
+    }
+
+    // 唤醒反应器线程：投递一个空任务，邮箱满说明线程本就不会睡
+    void Wake()
+    {
+        m_tasks.Post(std::function<void()>(), CMailbox<std::function<void()> >::FULL_FAIL);
+    }
+
+    void DispatchEvents(struct epoll_event* pEvents, int nCount)
+    {
+        for(int i = 0; i < nCount; ++i)
+        {
+            uint64_t uData = pEvents[i].data.u64;
+            if(WAKE_TAG == uData)
+            {
+                m_tasks.DrainEventFd();
+                continue;
+            }
+
+            // 前面的处理函数可能已摘除本fd，逐个按代号核对
+            int nFd = (int)(uint32_t)uData;
+            uint32_t uGen = (uint32_t)(uData >> 32);
+            std::shared_ptr<FdHandler> spHandler;
+            {
+                SCOPED_SAFELOCK(&m_lock);
+                if((size_t)nFd < m_vecEntries.size() && m_vecEntries[nFd].uGen == uGen)
+                {
+                    spHandler = m_vecEntries[nFd].spHandler;
+                }
+            }
+            if(spHandler)
+            {
+                (*spHandler)(nFd, pEvents[i].events);
+            }
+        }
+    }
+
+    void RunTasks(std::vector<std::function<void()> >& vecTasks)
+    {
+        // 本轮内新投递到本地的任务留到下一轮，免得任务不断自我投递时饿死fd事件
+        vecTasks.swap(m_vecLocalTasks);
+        for(size_t i = 0; i < vecTasks.size(); ++i)
+        {
+            vecTasks[i]();
+        }
+        vecTasks.clear();
+
+        if(m_tasks.PopBatch(vecTasks, TASK_BATCH) > 0)
+        {
+            for(size_t i = 0; i < vecTasks.size(); ++i)
+            {
+                if(vecTasks[i])     // 空任务只用于唤醒
+                {
+                    vecTasks[i]();
+                }
+            }
+            vecTasks.clear();
+        }
+    }
+
+    // 执行到期的定时器，返回到下一个定时器的毫秒数，没有定时器时返回-1
+    int RunTimers(std::vector<std::function<void()> >& vecFired)
+    {
+        uint64_t uWaitTicks = 0;
+        uint64_t uCurTick = 0;
+        {
+            SCOPED_SAFELOCK(&m_lock);
+            m_wheel.Advance(NowTick(), vecFired);
+            uWaitTicks = m_wheel.TicksToNextEvent();
+            uCurTick = m_wheel.CurrentTick();
+        }
+        for(size_t i = 0; i < vecFired.size(); ++i)
+        {
+            vecFired[i]();
+        }
+        vecFired.clear();
+
+        if(UINT64_MAX == uWaitTicks)
+        {
+            return -1;
+        }
+        uint64_t uTargetMs = (uCurTick + uWaitTicks) * m_uTickMs;
+        uint64_t uElapsedMs = ElapsedMs();
+        uint64_t uMs = (uTargetMs > uElapsedMs) ? uTargetMs - uElapsedMs : 0;
+        return (int)((uMs > INT_MAX) ? INT_MAX : uMs);
+    }
+
+    TimerId AddTimerImpl(uint32_t uDelayMs, uint32_t uPeriodMs, std::function<void()> fn)
+    {
+        // 向上取整到刻度，触发时间与要求的误差在一个刻度以内
+        uint64_t uDelayTicks = ((uint64_t)uDelayMs + m_uTickMs - 1) / m_uTickMs;
+        uint64_t uPeriodTicks = uPeriodMs ? (((uint64_t)uPeriodMs + m_uTickMs - 1) / m_uTickMs) : 0;
+        TimerId id = 0;
+        uint64_t uOldWait = 0;
+        uint64_t uNewWait = 0;
+        {
+            SCOPED_SAFELOCK(&m_lock);
+            // 反应器线程可能还没推进到当前时刻，先对齐再计算到期刻度
+            uint64_t uNow = NowTick();
+            uOldWait = m_wheel.TicksToNextEvent();
+            if(m_wheel.CurrentTick() < uNow)
+            {
+                uDelayTicks += uNow - m_wheel.CurrentTick();
+            }
+            id = m_wheel.Add(uDelayTicks, uPeriodTicks, std::move(fn));
+            uNewWait = m_wheel.TicksToNextEvent();
+        }
+        // 本线程内添加的会在下一轮重算超时，无需唤醒
+        if(uNewWait < uOldWait && !IsInReactorThread())
+        {
+            Wake();
+        }
+        return id;
+    }
+
+    uint64_t ElapsedMs() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - m_tpStart).count();
+    }
+
+    uint64_t NowTick() const
+    {
+        return ElapsedMs() / m_uTickMs;
+    }
+
+private:
+    int                                         m_nEpollFd;
+    uint32_t                                    m_uTickMs;
+    std::chrono::steady_clock::time_point       m_tpStart;      /*第0个刻度的起点*/
+    CFutexLock                                  m_lock;         /*保护m_vecEntries与m_wheel*/
+    std::vector<FdEntry>                        m_vecEntries;   /*按fd号下标*/
+    CTimingWheel                                m_wheel;
+    CMailbox<std::function<void()> >            m_tasks;        /*其他线程投递的任务*/
+    std::vector<std::function<void()> >         m_vecLocalTasks;/*本线程投递的任务，只由反应器线程访问*/
+    CStopCallback                               m_stopCallback; /*停止请求时唤醒epoll_wait*/
+};
@@ -0,0 +1,285 @@
+/********************************************************************
+	filename: 	RobustMutexLock.h
+
+	purpose:	跨进程命名锁，Linux下CMutexLock的替代
+	            锁放在以名字命名的POSIX共享内存里，是进程共享的robust pthread互斥量，
+	            无竞争时加锁、解锁都不进内核（glibc的futex实现），不像命名内核对象每次都是系统调用
+	            持锁进程崩溃后，下一个加锁者收到EOWNERDEAD，本类自动恢复锁的一致性并照常拿到锁，
+	            可通过IsOwnerDied()得知上一个持有者是非正常退出的，以便检查共享数据
+	            创建与删除经同名加".guard"的守护文件flock串行化，该文件留在/dev/shm下不删除
+	            glibc 2.34以前需链接-lrt -pthread
+*********************************************************************/
+#pragma once
+#ifndef __linux__
+#error "RobustMutexLock.h: Linux only, use CMutexLock on Windows"
+#endif
+#include <atomic>
+#include <string>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <assert.h>
+#include "LockHelper.h"
+
+class CRobustMutexLock final : public ISmartLock
+{
+public:
+    /** @fn CRobustMutexLock(const char* pszName)
+     *  @brief 打开名为pszName的锁，不存在则创建；已存在但创建者未完成初始化就崩溃时删掉重建；失败时IsValid()为false
+     *  @param (IN) const char* pszName 共享内存对象名，可不带前导'/'，不能含其他'/'
+     */
+    explicit CRobustMutexLock(const char* pszName)
+        : m_pShared(NULL)
+        , m_bAlreadyExist(false)
+        , m_bOwnerDied(false)
+    {
+        Open(ShmName(pszName));
+    }
+
+    ~CRobustMutexLock()
+    {
+        if(m_pShared)
+        {
+            munmap(m_pShared, sizeof(SharedBlock));
+            m_pShared = NULL;
+        }
+    }
+
+private: // 拒绝拷贝
+    CRobustMutexLock(const CRobustMutexLock&);
+    CRobustMutexLock& operator=(const CRobustMutexLock&);
+
+public:
+    void Lock()
+    {
+        assert(m_pShared != NULL);
+        if(m_pShared)
+        {
+            Recover(pthread_mutex_lock(&m_pShared->mutex));
+        }
+    }
+
+    void Unlock()
+    {
+        assert(m_pShared != NULL);
+        if(m_pShared)
+        {
+            pthread_mutex_unlock(&m_pShared->mutex);
+        }
+    }
+
+    bool TryLock()
+    {
+        assert(m_pShared != NULL);
+        return m_pShared && Recover(pthread_mutex_trylock(&m_pShared->mutex));
+    }
+
+    bool IsValid() const
+    {
+        return m_pShared != NULL;
+    }
+
+    bool IsAlreadyExist() const
+    {
+        return m_bAlreadyExist;
+    }
+
+    // 最近一次拿到锁时，上一个持有者是否死在锁里（共享数据可能只改了一半）
+    bool IsOwnerDied() const
+    {
+        return m_bOwnerDied;
+    }
+
+    /** @fn static bool Remove(const char* pszName)
+     *  @brief 删除共享内存对象，已打开的进程不受影响，之后再打开会新建一把锁
+     */
+    static bool Remove(const char* pszName)
+    {
+        std::string sName = ShmName(pszName);
+        int nGuard = LockGuard(sName);
+        bool bOk = 0 == shm_unlink(sName.c_str());
+        UnlockGuard(nGuard);
+        return bOk;
+    }
+
+private:
+    enum : uint32_t
+    {
+        READY_MAGIC = 0x524D5458u,  // "RMTX"，创建者初始化完互斥量后写入
+    };
+
+    struct SharedBlock
+    {
+        std::atomic<uint32_t>   uReady;
+        pthread_mutex_t         mutex;
+    };
+
+    // 打开或创建锁，成功时m_pShared非空
+    // 打开、创建、删除半成品都在守护文件的flock下进行：持有flock时看到未初始化完的锁，
+    // 说明创建者已死（flock随进程退出释放），删掉重建不会误删活着的创建者的锁，
+    // 也不会出现两个进程各删各建、各自拿着不同互斥量的情况
+    bool Open(const std::string& sName)
+    {
+        m_bAlreadyExist = false;
+        int nGuard = LockGuard(sName);
+        if(nGuard < 0)
+        {
+            return false;
+        }
+
+        int nFd = shm_open(sName.c_str(), O_RDWR, 0666);
+        if(nFd >= 0)
+        {
+            m_pShared = MapReady(nFd);
+            close(nFd);
+            if(m_pShared)
+            {
+                m_bAlreadyExist = true;
+            }
+            else
+            {
+                // 创建者在shm_open与初始化完成之间崩溃，留下永远不会就绪的半成品，不删掉的话之后每次打开都会失败
+                shm_unlink(sName.c_str());
+            }
+        }
+
+        if(NULL == m_pShared)
+        {
+            nFd = shm_open(sName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+            if(nFd >= 0)
+            {
+                if(0 == ftruncate(nFd, sizeof(SharedBlock)))
+                {
+                    m_pShared = Map(nFd);
+                }
+                if(m_pShared && !InitMutex(m_pShared))
+                {
+                    munmap(m_pShared, sizeof(SharedBlock));
+                    m_pShared = NULL;
+                }
+                if(!m_pShared)
+                {
+                    shm_unlink(sName.c_str());
+                }
+                close(nFd);
+            }
+        }
+
+        UnlockGuard(nGuard);
+        return m_pShared != NULL;
+    }
+
+    // 对守护文件加独占flock，返回其描述符，失败返回-1
+    // 守护文件与锁同在共享内存目录下，永不删除：删了之后来者会flock到另一个文件上，串行化就失效了
+    static int LockGuard(const std::string& sName)
+    {
+        int nGuard = shm_open((sName + ".guard").c_str(), O_RDONLY | O_CREAT, 0666);
+        if(nGuard < 0)
+        {
+            return -1;
+        }
+        int nRet = 0;
+        do
+        {
+            nRet = flock(nGuard, LOCK_EX);
+        } while(nRet != 0 && EINTR == errno);
+        if(nRet != 0)
+        {
+            close(nGuard);
+            return -1;
+        }
+        return nGuard;
+    }
+
+    static void UnlockGuard(int nGuard)
+    {
+        if(nGuard >= 0)
+        {
+            // 关闭即释放flock
+            close(nGuard);
+        }
+    }
+
+    static std::string ShmName(const char* pszName)
+    {
+        std::string sName(pszName ? pszName : "");
+        if(sName.empty() || sName[0] != '/')
+        {
+            sName.insert(0, 1, '/');
+        }
+        return sName;
+    }
+
+    static SharedBlock* Map(int nFd)
+    {
+        void* p = mmap(NULL, sizeof(SharedBlock), PROT_READ | PROT_WRITE, MAP_SHARED, nFd, 0);
+        return (MAP_FAILED == p) ? NULL : static_cast<SharedBlock*>(p);
+    }
+
+    static bool InitMutex(SharedBlock* pBlock)
+    {
+        pthread_mutexattr_t attr;
+        if(pthread_mutexattr_init(&attr) != 0)
+        {
+            return false;
+        }
+        bool bOk = 0 == pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED)
+            && 0 == pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST)
+            && 0 == pthread_mutex_init(&pBlock->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        if(bOk)
+        {
+            pBlock->uReady.store(READY_MAGIC, std::memory_order_release);
+        }
+        return bOk;
+    }
+
+    // 映射已存在的锁，长度不足（创建者死在ftruncate之前）或未初始化完成时返回NULL
+    static SharedBlock* MapReady(int nFd)
+    {
+        struct stat st;
+        if(fstat(nFd, &st) != 0 || st.st_size < (off_t)sizeof(SharedBlock))
+        {
+            return NULL;
+        }
+        SharedBlock* pBlock = Map(nFd);
+        if(pBlock && pBlock->uReady.load(std::memory_order_acquire) != READY_MAGIC)
+        {
+            munmap(pBlock, sizeof(SharedBlock));
+            pBlock = NULL;
+        }
+        return pBlock;
+    }
+
+    // 处理加锁结果，返回是否拿到了锁
+    bool Recover(int nRet)
+    {
+        if(EOWNERDEAD == nRet)
+        {
+            // 锁已归本线程，标记为一致后可继续正常使用
+            pthread_mutex_consistent(&m_pShared->mutex);
+            m_bOwnerDied = true;
+            return true;
+        }
+        // ENOTRECOVERABLE只会出现在有人拿到EOWNERDEAD却没有恢复就解锁时，本类不会这样做
+        assert(nRet != ENOTRECOVERABLE);
+        if(nRet != 0)
+        {
+            // 没拿到锁（如TryLock遇到EBUSY），不改动上一次拿到锁时的结论
+            return false;
+        }
+        m_bOwnerDied = false;
+        return true;
+    }
+
+private:
+    SharedBlock*    m_pShared;
+    bool            m_bAlreadyExist;
+    bool            m_bOwnerDied;
+};
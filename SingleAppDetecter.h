@@ -1,7 +1,14 @@
 #pragma once
 #include <string>
 #include <assert.h>
+#ifndef _WIN32
+#include "RobustMutexLock.h"
+#ifndef NO_XLOGGING
+#include "Logging.h"
+#endif
+#endif
 
+#ifdef _WIN32
 class CSingleAppDetecter
 {
 public:
@@ -44,3 +51,60 @@ private:
     HANDLE m_hMutex;
     std::string m_sMutexName;
 };
+#else
+class CSingleAppDetecter
+{
+public:
+    CSingleAppDetecter(const std::string& sInstanceName)
+        : m_pLock(NULL)
+        , m_sMutexName(sInstanceName)
+    {
+    }
+
+    ~CSingleAppDetecter()
+    {
+        Close();
+    }
+
+    // 一个实例只能调用一次
+    // 锁由调用线程持有，须在主线程等与进程同生命周期的线程里调用；
+    // 持有者进程崩溃后锁会被下一个启动的实例接管
+    // 锁打不开（无/dev/shm、无权限等）时同Windows版创建互斥量失败，记录错误并按无其他实例处理，不阻止启动
+    bool AnotherInstanceExists()
+    {
+        assert(NULL == m_pLock);
+        m_pLock = new CRobustMutexLock(m_sMutexName.c_str());
+        if(!m_pLock->IsValid())
+        {
+#ifndef NO_XLOGGING
+            LOG_ERROR << "Failed to open instance lock " << m_sMutexName << ". errno = " << errno;
+#endif
+            delete m_pLock;
+            m_pLock = NULL;
+            return false;
+        }
+        if(m_pLock->TryLock())
+        {
+            return false;
+        }
+
+        delete m_pLock;
+        m_pLock = NULL;
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_pLock)
+        {
+            m_pLock->Unlock();
+            delete m_pLock;
+            m_pLock = NULL;
+        }
+    }
+
+private:
+    CRobustMutexLock* m_pLock;
+    std::string m_sMutexName;
+};
+#endif // _WIN32
@@ -0,0 +1,272 @@
+/********************************************************************
+	filename: 	SnapshotHolder.h
+
+	purpose:	读多写少数据（配置等）的RCU快照容器
+	            写者整体替换出一个新版本并原子发布，旧版本等所有读线程都经过
+	            静默点(quiescent state)后才释放；读者拿到的始终是完整、不再变化的一份
+	            读路径CSnapshotHolder::Get()只有一次指针加载，不加锁、不写任何共享变量
+	            代价是读线程要登记：每个读线程持有一个CQsbrDomain::CReader，
+	            在不引用任何快照的地方（如工作循环每轮开头）调用Quiescent()，
+	            长时间阻塞前调用Offline()、醒来后Online()，否则旧版本迟迟不能释放
+	            未登记的线程用Acquire()取shared_ptr，要加锁但不受上述约束
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <stdint.h>
+#include "LockHelper.h"
+#include "FutexLock.h"
+
+//////////////////////////////////////////////////////////////////////////
+// 静默期检测：全局纪元号 + 每个读线程最近见到的纪元号
+//////////////////////////////////////////////////////////////////////////
+class CQsbrDomain
+{
+public:
+    enum : uint64_t
+    {
+        OFFLINE = ~(uint64_t)0,     // 读线程不在读，不阻挡任何回收
+    };
+
+    CQsbrDomain()
+        : m_uEpoch(1)
+        , m_pReaders(NULL)
+    {
+    }
+
+    // 进程级默认域，永不析构
+    static CQsbrDomain& Global()
+    {
+        static CQsbrDomain* s_pDomain = new CQsbrDomain;
+        return *s_pDomain;
+    }
+
+private: // 拒绝拷贝
+    CQsbrDomain(const CQsbrDomain&);
+    CQsbrDomain& operator=(const CQsbrDomain&);
+
+public:
+    //////////////////////////////////////////////////////////////////////////
+    // 读线程登记，只能由创建它的线程使用，构造后即为在线状态
+    //////////////////////////////////////////////////////////////////////////
+    class CReader
+    {
+    public:
+        explicit CReader(CQsbrDomain& domain = CQsbrDomain::Global())
+            : m_domain(domain)
+            , m_uSeen(OFFLINE)
+            , m_pNext(NULL)
+        {
+            m_domain.Register(this);
+            Online();
+        }
+
+        ~CReader()
+        {
+            Offline();
+            m_domain.Unregister(this);
+        }
+
+    private: // 拒绝拷贝
+        CReader(const CReader&);
+        CReader& operator=(const CReader&);
+
+    public:
+        // 声明此前拿到的快照指针都已不再使用
+        void Quiescent()
+        {
+            m_uSeen.store(m_domain.m_uEpoch.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        // 进入长时间阻塞前调用，离线期间不得使用快照指针
+        void Offline()
+        {
+            m_uSeen.store(OFFLINE, std::memory_order_release);
+        }
+
+        void Online()
+        {
+            m_uSeen.store(m_domain.m_uEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            // 与写者“换指针、再检查读者”配对：写者要么看到本线程已在线，要么本线程随后读到新指针
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+    private:
+        friend class CQsbrDomain;
+
+        CQsbrDomain&                        m_domain;
+        alignas(64) std::atomic<uint64_t>   m_uSeen;    /*最近的静默点见到的纪元号，只有本线程写*/
+        CReader*                            m_pNext;
+    };
+
+    /** @fn uint64_t Advance()
+     *  @brief 写者换下旧版本后推进纪元，返回新纪元号；
+     *    所有在线读者见到的纪元号都不小于它时，旧版本即可释放
+     */
+    uint64_t Advance()
+    {
+        return m_uEpoch.fetch_add(1) + 1;
+    }
+
+    bool IsGracePassed(uint64_t uEpoch)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        for(CReader* p = m_pReaders; p; p = p->m_pNext)
+        {
+            if(p->m_uSeen.load(std::memory_order_seq_cst) < uEpoch)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 等到当前所有在线读者都经过静默点；调用线程自身若是在线读者会永远等下去
+    void Synchronize()
+    {
+        uint64_t uEpoch = Advance();
+        while(!IsGracePassed(uEpoch))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+private:
+    void Register(CReader* pReader)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        pReader->m_pNext = m_pReaders;
+        m_pReaders = pReader;
+    }
+
+    void Unregister(CReader* pReader)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        for(CReader** pp = &m_pReaders; *pp; pp = &(*pp)->m_pNext)
+        {
+            if(*pp == pReader)
+            {
+                *pp = pReader->m_pNext;
+                break;
+            }
+        }
+    }
+
+private:
+    std::atomic<uint64_t>   m_uEpoch;
+    CFutexLock              m_lock;         /*保护读者链表，只在登记和写者检查时使用*/
+    CReader*                m_pReaders;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 快照容器，T的实例发布后不得再修改
+//////////////////////////////////////////////////////////////////////////
+template<class T>
+class CSnapshotHolder
+{
+public:
+    explicit CSnapshotHolder(CQsbrDomain& domain = CQsbrDomain::Global())
+        : m_domain(domain)
+        , m_pCur(NULL)
+    {
+    }
+
+    // 析构时须已没有读者在使用本容器的快照
+    ~CSnapshotHolder()
+    {
+    }
+
+private: // 拒绝拷贝
+    CSnapshotHolder(const CSnapshotHolder&);
+    CSnapshotHolder& operator=(const CSnapshotHolder&);
+
+public:
+    /** @fn const T* Get() const
+     *  @brief 取当前版本，尚未发布时为NULL；须由在线的已登记读线程调用，
+     *    返回的指针在本线程下次Quiescent()/Offline()之前有效
+     */
+    const T* Get() const
+    {
+        return m_pCur.load(std::memory_order_acquire);
+    }
+
+    // 取当前版本的共享引用，任何线程可用，可长期持有
+    std::shared_ptr<const T> Acquire() const
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        return m_spCur;
+    }
+
+    /** @fn void Publish(std::shared_ptr<const T> spNew)
+     *  @brief 原子地换成新版本，旧版本在静默期过后释放（仍被Acquire()持有的随最后一个引用释放）
+     *    顺带回收此前已过静默期的旧版本
+     */
+    void Publish(std::shared_ptr<const T> spNew)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        std::shared_ptr<const T> spOld = std::move(m_spCur);
+        m_spCur = std::move(spNew);
+        m_pCur.store(m_spCur.get(), std::memory_order_seq_cst);
+        if(spOld)
+        {
+            Retired retired;
+            retired.uEpoch = m_domain.Advance();
+            retired.spValue = std::move(spOld);
+            m_lstRetired.push_back(std::move(retired));
+        }
+        ReclaimLocked();
+    }
+
+    template<class... Args>
+    void Emplace(Args&&... args)
+    {
+        Publish(std::make_shared<const T>(std::forward<Args>(args)...));
+    }
+
+    // 释放已过静默期的旧版本，发布间隔很长时可由写者定期调用
+    void Reclaim()
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        ReclaimLocked();
+    }
+
+    // 阻塞到当前所有旧版本都可释放并释放之，调用线程不能是在线读者
+    void Synchronize()
+    {
+        m_domain.Synchronize();
+        Reclaim();
+    }
+
+    size_t RetiredCount() const
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        return m_lstRetired.size();
+    }
+
+private:
+    struct Retired
+    {
+        uint64_t                    uEpoch;     /*换下时推进到的纪元号*/
+        std::shared_ptr<const T>    spValue;
+    };
+
+    // 旧版本按纪元号递增排列，遇到第一个未过静默期的即可停止
+    void ReclaimLocked()
+    {
+        while(!m_lstRetired.empty() && m_domain.IsGracePassed(m_lstRetired.front().uEpoch))
+        {
+            m_lstRetired.pop_front();
+        }
+    }
+
+private:
+    CQsbrDomain&                m_domain;
+    std::atomic<const T*>       m_pCur;         /*读路径只读这一个字*/
+    mutable CFutexLock          m_lock;         /*写者之间、以及Acquire()与写者之间互斥*/
+    std::shared_ptr<const T>    m_spCur;
+    std::list<Retired>          m_lstRetired;
+};
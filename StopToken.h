@@ -0,0 +1,257 @@
+/********************************************************************
+	filename: 	StopToken.h
+
+	purpose:	协作式取消：CStopSource发出停止请求，CStopToken供等待方查询与可中断睡眠，
+	            CStopCallback在停止请求发出时回调，用于唤醒睡在其他对象上的等待
+	            （邮箱Interrupt、写eventfd、SetEvent等），使各类阻塞等待都能立即返回
+	            与C++20 std::stop_source不同，停止源可Reset后复用，回调在每次停止请求时都会执行，
+	            适合工作线程反复Run/Stop的用法
+	            回调在持锁状态下执行，须短小、不阻塞，且不得在回调内注册或注销回调
+            Windows下用临界区与手动复位事件实现，不依赖WaitOnAddress，工作线程基类因此不要求Win8
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <limits.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include "LockHelper.h"
+#else
+#include "FutexLock.h"
+#endif
+
+class CStopCallback;
+
+class CStopSource
+{
+public:
+    CStopSource()
+        : m_uStopped(0)
+        , m_pCallbacks(NULL)
+    {
+#ifdef _WIN32
+        m_hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+#endif
+    }
+
+#ifdef _WIN32
+    ~CStopSource()
+    {
+        if(m_hStopEvent)
+        {
+            CloseHandle(m_hStopEvent);
+            m_hStopEvent = NULL;
+        }
+    }
+#endif
+
+private: // 拒绝拷贝
+    CStopSource(const CStopSource&);
+    CStopSource& operator=(const CStopSource&);
+
+public:
+    /** @fn bool RequestStop()
+     *  @brief 发出停止请求：唤醒所有SleepFor中的线程并执行已注册的回调
+     *  @return bool 本次调用是否由未停止变为已停止
+     */
+    inline bool RequestStop();
+
+    bool StopRequested() const
+    {
+        return 0 != m_uStopped.load(std::memory_order_acquire);
+    }
+
+    // 清除停止状态以便复用，已注册的回调保留；只能在没有线程依赖本次停止请求时调用（如线程已join）
+    void Reset()
+    {
+        m_uStopped.store(0, std::memory_order_release);
+#ifdef _WIN32
+        ResetEvent(m_hStopEvent);
+#endif
+    }
+
+private:
+    friend class CStopToken;
+    friend class CStopCallback;
+
+    // 唤醒所有睡在本停止源上的线程
+    void WakeSleepers()
+    {
+#ifdef _WIN32
+        SetEvent(m_hStopEvent);
+#else
+        LockDetail::FutexWake(&m_uStopped, INT_MAX);
+#endif
+    }
+
+    // 未停止时至多睡uMs毫秒，可能提前返回，由调用方复查停止状态
+    void WaitStop(uint32_t uMs)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(m_hStopEvent, uMs);
+#else
+        LockDetail::FutexWait(&m_uStopped, 0, uMs);
+#endif
+    }
+
+private:
+    std::atomic<uint32_t>   m_uStopped;     /*Linux下同时作为SleepFor的futex字*/
+#ifdef _WIN32
+    CCriticalSectionLock    m_lock;         /*保护回调链表*/
+    HANDLE                  m_hStopEvent;   /*停止时置位，SleepFor在其上等待*/
+#else
+    CFutexLock              m_lock;         /*保护回调链表*/
+#endif
+    CStopCallback*          m_pCallbacks;
+};
+
+// 停止源的只读视图，可随意拷贝；停止源须比所有令牌活得长
+class CStopToken
+{
+public:
+    CStopToken()
+        : m_pSource(NULL)
+    {
+    }
+
+    explicit CStopToken(CStopSource* pSource)
+        : m_pSource(pSource)
+    {
+    }
+
+public:
+    bool StopPossible() const
+    {
+        return m_pSource != NULL;
+    }
+
+    bool StopRequested() const
+    {
+        return m_pSource && m_pSource->StopRequested();
+    }
+
+    /** @fn bool SleepFor(uint32_t uMs) const
+     *  @brief 可中断的Sleep，停止请求发出时立即返回
+     *  @param (IN) uint32_t uMs 睡眠时间，(uint32_t)-1表示一直睡到停止请求
+     *  @return bool 睡满返回true，因停止请求提前返回false
+     */
+    bool SleepFor(uint32_t uMs) const
+    {
+        if(NULL == m_pSource)
+        {
+            if(uMs != (uint32_t)-1)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(uMs));
+            }
+            return true;
+        }
+
+        std::chrono::steady_clock::time_point tpDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uMs);
+        while(!m_pSource->StopRequested())
+        {
+            uint32_t uWaitMs = (uint32_t)-1;
+            if(uMs != (uint32_t)-1)
+            {
+                std::chrono::steady_clock::time_point tpNow = std::chrono::steady_clock::now();
+                if(tpNow >= tpDeadline)
+                {
+                    return true;
+                }
+                uWaitMs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(tpDeadline - tpNow).count() + 1;
+            }
+            m_pSource->WaitStop(uWaitMs);
+        }
+        return false;
+    }
+
+private:
+    friend class CStopCallback;
+
+    CStopSource*    m_pSource;
+};
+
+// 在生命期内登记一个停止回调；登记时若已处于停止状态则立即执行一次
+class CStopCallback
+{
+public:
+    CStopCallback(const CStopToken& token, std::function<void()> fn)
+        : m_pSource(token.m_pSource)
+        , m_fn(std::move(fn))
+        , m_pPrev(NULL)
+        , m_pNext(NULL)
+    {
+        if(NULL == m_pSource)
+        {
+            return;
+        }
+
+        bool bStopped = false;
+        {
+            SCOPED_SAFELOCK(&m_pSource->m_lock);
+            m_pNext = m_pSource->m_pCallbacks;
+            if(m_pNext)
+            {
+                m_pNext->m_pPrev = this;
+            }
+            m_pSource->m_pCallbacks = this;
+            bStopped = m_pSource->StopRequested();
+        }
+        if(bStopped)
+        {
+            m_fn();
+        }
+    }
+
+    // 持锁摘链，正在执行的回调结束前不会返回
+    ~CStopCallback()
+    {
+        if(NULL == m_pSource)
+        {
+            return;
+        }
+
+        SCOPED_SAFELOCK(&m_pSource->m_lock);
+        if(m_pPrev)
+        {
+            m_pPrev->m_pNext = m_pNext;
+        }
+        else
+        {
+            m_pSource->m_pCallbacks = m_pNext;
+        }
+        if(m_pNext)
+        {
+            m_pNext->m_pPrev = m_pPrev;
+        }
+    }
+
+private: // 拒绝拷贝
+    CStopCallback(const CStopCallback&);
+    CStopCallback& operator=(const CStopCallback&);
+
+private:
+    friend class CStopSource;
+
+    CStopSource*            m_pSource;
+    std::function<void()>   m_fn;
+    CStopCallback*          m_pPrev;
+    CStopCallback*          m_pNext;
+};
+
+inline bool CStopSource::RequestStop()
+{
+    SCOPED_SAFELOCK(&m_lock);
+    if(StopRequested())
+    {
+        return false;
+    }
+    m_uStopped.store(1, std::memory_order_release);
+    WakeSleepers();
+    for(CStopCallback* p = m_pCallbacks; p != NULL; p = p->m_pNext)
+    {
+        p->m_fn();
+    }
+    return true;
+}
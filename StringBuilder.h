@@ -0,0 +1,214 @@
+/********************************************************************
+	filename: 	StringBuilder.h
+
+	purpose:	分块字符串构建器，用于拼接大文本（状态报告、上报数据等）
+	            数据追加在一串内存块中，扩容只新增块而不搬移已写入的内容，
+	            最后一次性拼成std::string，或按块直接导出做分散写
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <string.h>
+#include "StringFormat.h"
+#include "StringConvert.h"
+
+namespace StringHelper
+{
+    class CStringBuilder
+    {
+    public:
+        enum
+        {
+            DEFAULT_FIRST_CHUNK = 4 * 1024,     // 首块大小
+            MAX_CHUNK           = 1024 * 1024,  // 块大小按倍数增长到此为止
+        };
+
+        explicit CStringBuilder(size_t uFirstChunk = DEFAULT_FIRST_CHUNK)
+            : m_uNextChunk(uFirstChunk ? uFirstChunk : (size_t)DEFAULT_FIRST_CHUNK)
+            , m_uLength(0)
+        {
+        }
+
+    private: // 拒绝拷贝
+        CStringBuilder(const CStringBuilder&);
+        CStringBuilder& operator=(const CStringBuilder&);
+
+    public:
+        CStringBuilder& Append(const char* p, size_t n)
+        {
+            m_uLength += n;
+            while(n > 0)
+            {
+                if(m_vecChunks.empty() || m_vecChunks.back().uLen == m_vecChunks.back().uCap)
+                {
+                    AddChunk(n);
+                }
+                Chunk& chunk = m_vecChunks.back();
+                size_t uCopy = (n < chunk.uCap - chunk.uLen) ? n : chunk.uCap - chunk.uLen;
+                memcpy(chunk.spBuf.get() + chunk.uLen, p, uCopy);
+                chunk.uLen += uCopy;
+                p += uCopy;
+                n -= uCopy;
+            }
+            return *this;
+        }
+
+        CStringBuilder& Append(std::string_view s)
+        {
+            return Append(s.data(), s.length());
+        }
+
+        CStringBuilder& Append(size_t nCount, char ch)
+        {
+            m_uLength += nCount;
+            while(nCount > 0)
+            {
+                if(m_vecChunks.empty() || m_vecChunks.back().uLen == m_vecChunks.back().uCap)
+                {
+                    AddChunk(nCount);
+                }
+                Chunk& chunk = m_vecChunks.back();
+                size_t uFill = (nCount < chunk.uCap - chunk.uLen) ? nCount : chunk.uCap - chunk.uLen;
+                memset(chunk.spBuf.get() + chunk.uLen, ch, uFill);
+                chunk.uLen += uFill;
+                nCount -= uFill;
+            }
+            return *this;
+        }
+
+        CStringBuilder& Append(char ch)
+        {
+            return Append(1, ch);
+        }
+
+        // 数值直接写入，整数十进制，浮点数为最短可还原表示
+        template<class T>
+        CStringBuilder& AppendNumber(T val)
+        {
+            static_assert(detail::IsCharsConvertible<T>::value, "CStringBuilder::AppendNumber: T must be a non-character arithmetic type");
+            char chBuf[64];
+            std::to_chars_result res = std::to_chars(chBuf, chBuf + sizeof(chBuf), val);
+            return Append(chBuf, res.ptr - chBuf);
+        }
+
+        // 与StringHelper::AppendString(STRFMT(...))相同的格式化，结果直接写入块中，不产生临时字符串
+        template<class F, class... Args>
+        typename std::enable_if<detail::IsFormatLiteral<F>::value, CStringBuilder&>::type
+            AppendFormat(F, const Args&... args)
+        {
+            detail::FormatTo<F>(*this, args...);
+            return *this;
+        }
+
+        CStringBuilder& operator<<(std::string_view s)
+        {
+            return Append(s);
+        }
+
+        CStringBuilder& operator<<(char ch)
+        {
+            return Append(ch);
+        }
+
+        // 与std::string相同的append接口，供格式化等模板代码使用
+        CStringBuilder& append(const char* p, size_t n)
+        {
+            return Append(p, n);
+        }
+
+        CStringBuilder& append(std::string_view s)
+        {
+            return Append(s);
+        }
+
+        CStringBuilder& append(size_t nCount, char ch)
+        {
+            return Append(nCount, ch);
+        }
+
+    public:
+        size_t Length() const
+        {
+            return m_uLength;
+        }
+
+        bool Empty() const
+        {
+            return 0 == m_uLength;
+        }
+
+        // 清空内容，保留首块以便复用
+        void Clear()
+        {
+            if(m_vecChunks.size() > 1)
+            {
+                m_vecChunks.resize(1);
+            }
+            if(!m_vecChunks.empty())
+            {
+                m_vecChunks[0].uLen = 0;
+                m_uNextChunk = m_vecChunks[0].uCap * 2;
+            }
+            m_uLength = 0;
+        }
+
+        // 将全部内容追加到output，output只扩容一次
+        void FlattenTo(std::string& output) const
+        {
+            output.reserve(output.length() + m_uLength);
+            for(size_t i = 0; i < m_vecChunks.size(); ++i)
+            {
+                output.append(m_vecChunks[i].spBuf.get(), m_vecChunks[i].uLen);
+            }
+        }
+
+        std::string Flatten() const
+        {
+            std::string output;
+            FlattenTo(output);
+            return output;
+        }
+
+        // 按顺序导出各块，可直接填充WSABUF/iovec做分散写，视图在下次修改前有效
+        void GetChunks(std::vector<std::string_view>& vecChunks) const
+        {
+            vecChunks.reserve(vecChunks.size() + m_vecChunks.size());
+            for(size_t i = 0; i < m_vecChunks.size(); ++i)
+            {
+                if(m_vecChunks[i].uLen > 0)
+                {
+                    vecChunks.push_back(std::string_view(m_vecChunks[i].spBuf.get(), m_vecChunks[i].uLen));
+                }
+            }
+        }
+
+    private:
+        struct Chunk
+        {
+            std::unique_ptr<char[]> spBuf;
+            size_t                  uCap;
+            size_t                  uLen;
+        };
+
+        void AddChunk(size_t uNeed)
+        {
+            size_t uCap = (uNeed > m_uNextChunk) ? uNeed : m_uNextChunk;
+            Chunk chunk;
+            chunk.spBuf.reset(new char[uCap]);
+            chunk.uCap = uCap;
+            chunk.uLen = 0;
+            m_vecChunks.push_back(std::move(chunk));
+            if(m_uNextChunk < MAX_CHUNK)
+            {
+                m_uNextChunk *= 2;
+            }
+        }
+
+    private:
+        std::vector<Chunk>  m_vecChunks;
+        size_t              m_uNextChunk;   /*下一块的大小*/
+        size_t              m_uLength;      /*总长度*/
+    };
+}
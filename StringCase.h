@@ -0,0 +1,251 @@
+/********************************************************************
+	filename: 	StringCase.h
+
+	purpose:	ASCII大小写转换及忽略大小写的比较、查找、哈希
+	            只处理A-Z/a-z，其余字节（包括GBK等多字节编码的字节）原样保留，
+	            结果不受locale影响。SIMD选择与StringScan.h相同
+*********************************************************************/
+#pragma once
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include "StringScan.h"
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        inline char AsciiToLower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+        }
+
+        inline char AsciiToUpper(char c)
+        {
+            return (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+        }
+
+        // 8字节并行转小写：大写字母的第5位置1，高位为1的字节不受影响
+        inline uint64_t AsciiToLower64(uint64_t w)
+        {
+            const uint64_t uOnes = 0x0101010101010101ULL;
+            uint64_t uHeptets = w & (0x7F * uOnes);
+            uint64_t uGeA = uHeptets + (0x80 - 'A') * uOnes;
+            uint64_t uGtZ = uHeptets + (0x80 - 'Z' - 1) * uOnes;
+            uint64_t uIsUpper = uGeA & ~uGtZ & ~w & (0x80 * uOnes);
+            return w | (uIsUpper >> 2);
+        }
+
+        inline uint64_t LoadWord64(const char* p)
+        {
+            uint64_t w;
+            memcpy(&w, p, sizeof(w));
+            return w;
+        }
+
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        // chFrom为'A'时标出大写字母，为'a'时标出小写字母
+        inline __m128i AsciiRangeMask16(__m128i v, char chFrom)
+        {
+            __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - chFrom)));
+            return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + 26)));
+        }
+
+        inline __m128i AsciiToLower16(__m128i v)
+        {
+            return _mm_or_si128(v, _mm_and_si128(AsciiRangeMask16(v, 'A'), _mm_set1_epi8(0x20)));
+        }
+#endif
+
+#if defined(STRINGHELPER_AVX2)
+        inline __m256i AsciiRangeMask32(__m256i v, char chFrom)
+        {
+            __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - chFrom)));
+            return _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-128 + 26)), shifted);
+        }
+
+        inline __m256i AsciiToLower32(__m256i v)
+        {
+            return _mm256_or_si256(v, _mm256_and_si256(AsciiRangeMask32(v, 'A'), _mm256_set1_epi8(0x20)));
+        }
+#endif
+
+        /** @fn inline void AsciiCaseConvert(char* p, size_t n, bool bUpper)
+         *  @brief 原地转换[p, p+n)的ASCII大小写
+         */
+        inline void AsciiCaseConvert(char* p, size_t n, bool bUpper)
+        {
+            size_t i = 0;
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            const char chFrom = bUpper ? 'a' : 'A';   // 只有向量路径用到
+#endif
+#if defined(STRINGHELPER_AVX2)
+            for(; i + 32 <= n; i += 32)
+            {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+                __m256i flip = _mm256_and_si256(AsciiRangeMask32(v, chFrom), _mm256_set1_epi8(0x20));
+                _mm256_storeu_si256((__m256i*)(p + i), _mm256_xor_si256(v, flip));
+            }
+#endif
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            for(; i + 16 <= n; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+                __m128i flip = _mm_and_si128(AsciiRangeMask16(v, chFrom), _mm_set1_epi8(0x20));
+                _mm_storeu_si128((__m128i*)(p + i), _mm_xor_si128(v, flip));
+            }
+#endif
+            for(; i < n; ++i)
+            {
+                p[i] = bUpper ? AsciiToUpper(p[i]) : AsciiToLower(p[i]);
+            }
+        }
+
+        // 长度相同的两段内存忽略大小写是否相等
+        inline bool AsciiEqualsNoCase(const char* a, const char* b, size_t n)
+        {
+            size_t i = 0;
+#if defined(STRINGHELPER_AVX2)
+            for(; i + 32 <= n; i += 32)
+            {
+                __m256i va = AsciiToLower32(_mm256_loadu_si256((const __m256i*)(a + i)));
+                __m256i vb = AsciiToLower32(_mm256_loadu_si256((const __m256i*)(b + i)));
+                if((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != 0xFFFFFFFF)
+                {
+                    return false;
+                }
+            }
+#endif
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            for(; i + 16 <= n; i += 16)
+            {
+                __m128i va = AsciiToLower16(_mm_loadu_si128((const __m128i*)(a + i)));
+                __m128i vb = AsciiToLower16(_mm_loadu_si128((const __m128i*)(b + i)));
+                if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+                {
+                    return false;
+                }
+            }
+#endif
+            for(; i + 8 <= n; i += 8)
+            {
+                if(AsciiToLower64(LoadWord64(a + i)) != AsciiToLower64(LoadWord64(b + i)))
+                {
+                    return false;
+                }
+            }
+            for(; i < n; ++i)
+            {
+                if(AsciiToLower(a[i]) != AsciiToLower(b[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    inline void AsciiUpper(std::string& s)
+    {
+        if(!s.empty())
+        {
+            detail::AsciiCaseConvert(&s[0], s.length(), true);
+        }
+    }
+
+    inline void AsciiLower(std::string& s)
+    {
+        if(!s.empty())
+        {
+            detail::AsciiCaseConvert(&s[0], s.length(), false);
+        }
+    }
+
+    // 忽略ASCII大小写判断是否相等
+    inline bool EqualsNoCase(std::string_view a, std::string_view b)
+    {
+        return a.length() == b.length() && detail::AsciiEqualsNoCase(a.data(), b.data(), a.length());
+    }
+
+    /** @fn inline size_t FindNoCase(std::string_view s, std::string_view sub, size_t pos = 0)
+     *  @brief 忽略ASCII大小写查找子串，语义同std::string::find
+     *    以首字符的大小写两种形式做SIMD预筛，再逐个候选位置比较
+     */
+    inline size_t FindNoCase(std::string_view s, std::string_view sub, size_t pos = 0)
+    {
+        if(pos > s.length() || sub.length() > s.length() - pos)
+        {
+            return std::string_view::npos;
+        }
+        if(sub.empty())
+        {
+            return pos;
+        }
+
+        const char chLower = detail::AsciiToLower(sub[0]);
+        const char chUpper = detail::AsciiToUpper(sub[0]);
+        const size_t uLast = s.length() - sub.length();    // 最后一个可能的起点
+        size_t i = pos;
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        const __m128i vLower = _mm_set1_epi8(chLower);
+        const __m128i vUpper = _mm_set1_epi8(chUpper);
+        for(; i + 16 <= uLast + 1; i += 16)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*)(s.data() + i));
+            uint32_t uMask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, vLower), _mm_cmpeq_epi8(block, vUpper)));
+            while(uMask)
+            {
+                size_t uCandidate = i + detail::LowestBit(uMask);
+                if(detail::AsciiEqualsNoCase(s.data() + uCandidate + 1, sub.data() + 1, sub.length() - 1))
+                {
+                    return uCandidate;
+                }
+                uMask &= uMask - 1;
+            }
+        }
+#endif
+        for(; i <= uLast; ++i)
+        {
+            if((s[i] == chLower || s[i] == chUpper)
+                && detail::AsciiEqualsNoCase(s.data() + i + 1, sub.data() + 1, sub.length() - 1))
+            {
+                return i;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    // 忽略ASCII大小写的哈希，与CNoCaseEqual配合用于unordered容器：
+    //     std::unordered_map<std::string, CValue, CNoCaseHash, CNoCaseEqual>
+    struct CNoCaseHash
+    {
+        size_t operator()(std::string_view s) const
+        {
+            const uint64_t uMul = 0x9E3779B97F4A7C15ULL;
+            uint64_t h = s.length() * uMul;
+            size_t i = 0;
+            for(; i + 8 <= s.length(); i += 8)
+            {
+                h = (h ^ detail::AsciiToLower64(detail::LoadWord64(s.data() + i))) * uMul;
+                h ^= h >> 32;
+            }
+            if(i < s.length())
+            {
+                uint64_t w = 0;
+                memcpy(&w, s.data() + i, s.length() - i);
+                h = (h ^ detail::AsciiToLower64(w)) * uMul;
+                h ^= h >> 32;
+            }
+            return (size_t)h;
+        }
+    };
+
+    struct CNoCaseEqual
+    {
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            return EqualsNoCase(a, b);
+        }
+    };
+}
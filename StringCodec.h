@@ -0,0 +1,368 @@
+/********************************************************************
+	filename: 	StringCodec.h
+
+	purpose:	十六进制与Base64(RFC 4648标准字母表，带'='填充)编解码
+	            结果追加到调用方的缓冲区；解码严格校验，出错时缓冲区恢复原长度并给出出错位置
+	            十六进制用SSE2，Base64用SSSE3(pshufb)，不可用时走查表的标量实现
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+#include "StringScan.h"
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // 字符到6位/4位值的反查表，非法字符为-1
+        struct CDecodeTable
+        {
+            int8_t val[256];
+
+            constexpr CDecodeTable(std::string_view sAlphabet, bool bNoCase)
+                : val()
+            {
+                for(size_t i = 0; i < 256; ++i)
+                {
+                    val[i] = -1;
+                }
+                for(size_t i = 0; i < sAlphabet.length(); ++i)
+                {
+                    unsigned char c = (unsigned char)sAlphabet[i];
+                    val[c] = (int8_t)i;
+                    if(bNoCase && c >= 'a' && c <= 'z')
+                    {
+                        val[c - ('a' - 'A')] = (int8_t)i;
+                    }
+                }
+            }
+        };
+
+        static constexpr char chHexLower[] = "0123456789abcdef";
+        static constexpr char chHexUpper[] = "0123456789ABCDEF";
+        static constexpr char chBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        static constexpr CDecodeTable tblHex(std::string_view(chHexLower, 16), true);
+        static constexpr CDecodeTable tblBase64(std::string_view(chBase64, 64), false);
+
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        // 16个0-15的半字节转为十六进制字符
+        inline __m128i NibbleToHex16(__m128i n, bool bUpper)
+        {
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8((char)((bUpper ? 'A' : 'a') - '0' - 10)));
+            return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), alpha);
+        }
+
+        // 16个十六进制字符转为半字节，存在非法字符时返回false
+        inline bool HexToNibble16(__m128i v, __m128i& n)
+        {
+            __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+            __m128i isDigit = _mm_cmplt_epi8(_mm_add_epi8(digit, _mm_set1_epi8((char)0x80)), _mm_set1_epi8((char)(-128 + 10)));
+            __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+            __m128i isAlpha = _mm_cmplt_epi8(_mm_add_epi8(alpha, _mm_set1_epi8((char)0x80)), _mm_set1_epi8((char)(-128 + 6)));
+            if(_mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha)) != 0xFFFF)
+            {
+                return false;
+            }
+            n = _mm_or_si128(_mm_and_si128(isDigit, digit), _mm_and_si128(isAlpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+            return true;
+        }
+#endif
+
+#if defined(STRINGHELPER_SSSE3)
+        // 12字节(读取16字节)编码为16个Base64字符
+        inline __m128i Base64Encode12(__m128i in)
+        {
+            in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+            __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+            __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+            __m128i idx = _mm_or_si128(t0, t1);
+
+            // 按区间求各6位值到字符的偏移：0-25 'A'，26-51 'a'，52-61 '0'，62 '+'，63 '/'
+            const __m128i shiftLUT = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+            __m128i sel = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+            sel = _mm_or_si128(sel, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+            return _mm_add_epi8(_mm_shuffle_epi8(shiftLUT, sel), idx);
+        }
+
+        // 16个Base64字符解码为12字节(位于结果的低12字节)，存在非法字符(含'=')时返回false
+        inline bool Base64Decode16(__m128i in, __m128i& out)
+        {
+            const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+            const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+            const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+
+            __m128i hiNibble = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+            __m128i loNibble = _mm_and_si128(in, _mm_set1_epi8(0x0F));
+            __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lutLo, loNibble), _mm_shuffle_epi8(lutHi, hiNibble));
+            if(_mm_movemask_epi8(_mm_cmpgt_epi8(bad, _mm_setzero_si128())))
+            {
+                return false;
+            }
+
+            __m128i isSlash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+            __m128i val = _mm_add_epi8(in, _mm_shuffle_epi8(lutRoll, _mm_add_epi8(isSlash, hiNibble)));
+            __m128i merged = _mm_maddubs_epi16(val, _mm_set1_epi32(0x01400140));
+            merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+            out = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            return true;
+        }
+#endif
+
+        /** @fn inline size_t Base64DecodeQuad(const char* pSrc, bool bLast, unsigned char* pDst, size_t& uBad)
+         *  @brief 解码一组4个字符，只有最后一组允许'='填充
+         *  @param (OUT) size_t& uBad 失败时为组内出错字符的下标
+         *  @return size_t 写入pDst的字节数(1-3)，失败返回0
+         */
+        inline size_t Base64DecodeQuad(const char* pSrc, bool bLast, unsigned char* pDst, size_t& uBad)
+        {
+            uint32_t u = 0;
+            size_t uPad = 0;
+            for(size_t k = 0; k < 4; ++k)
+            {
+                int8_t v = tblBase64.val[(unsigned char)pSrc[k]];
+                if(pSrc[k] == '=' && bLast && k >= 2 && pSrc[3] == '=')
+                {
+                    v = 0;
+                    ++uPad;
+                }
+                else if(v < 0)
+                {
+                    uBad = k;
+                    return 0;
+                }
+                u = (u << 6) | (uint32_t)v;
+            }
+
+            // 填充前最后一个字符中未用到的位须为0
+            if((2 == uPad && (u & 0xFFFF)) || (1 == uPad && (u & 0xFF)))
+            {
+                uBad = 3 - uPad;
+                return 0;
+            }
+            pDst[0] = (unsigned char)(u >> 16);
+            pDst[1] = (unsigned char)(u >> 8);
+            pDst[2] = (unsigned char)u;
+            return 3 - uPad;
+        }
+    }
+
+    /** @fn inline void HexEncode(std::string& output, const void* pData, size_t nLen, bool bUpper = false)
+     *  @brief 将[pData, pData+nLen)编码为十六进制追加到output
+     *  @param (IN) bool bUpper 是否使用大写字母
+     */
+    inline void HexEncode(std::string& output, const void* pData, size_t nLen, bool bUpper = false)
+    {
+        if(0 == nLen)
+        {
+            return;
+        }
+        const unsigned char* pSrc = static_cast<const unsigned char*>(pData);
+        const char* pDigits = bUpper ? detail::chHexUpper : detail::chHexLower;
+        size_t uOld = output.length();
+        output.resize(uOld + nLen * 2);
+        char* pDst = &output[uOld];
+
+        size_t i = 0;
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        for(; i + 16 <= nLen; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(pSrc + i));
+            __m128i hi = detail::NibbleToHex16(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)), bUpper);
+            __m128i lo = detail::NibbleToHex16(_mm_and_si128(v, _mm_set1_epi8(0x0F)), bUpper);
+            _mm_storeu_si128((__m128i*)(pDst + i * 2), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128((__m128i*)(pDst + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+#endif
+        for(; i < nLen; ++i)
+        {
+            pDst[i * 2] = pDigits[pSrc[i] >> 4];
+            pDst[i * 2 + 1] = pDigits[pSrc[i] & 0x0F];
+        }
+    }
+
+    inline std::string HexEncode(std::string_view data, bool bUpper = false)
+    {
+        std::string output;
+        HexEncode(output, data.data(), data.length(), bUpper);
+        return output;
+    }
+
+    /** @fn inline bool HexDecode(std::string& output, std::string_view sHex, size_t* pErrorPos = NULL)
+     *  @brief 将十六进制串解码追加到output，大小写字母均可，不允许空白、前缀或奇数长度
+     *  @param (OUT) size_t* pErrorPos 失败时为第一个非法字符的下标，长度为奇数时为最后一个字符的下标
+     *  @return bool 失败时output保持原内容
+     */
+    inline bool HexDecode(std::string& output, std::string_view sHex, size_t* pErrorPos = NULL)
+    {
+        const size_t uOld = output.length();
+        const size_t uLen = sHex.length() / 2;
+        output.resize(uOld + uLen);
+        unsigned char* pDst = reinterpret_cast<unsigned char*>(&output[0] + uOld);
+        const char* pSrc = sHex.data();
+
+        size_t i = 0;
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        for(; i + 16 <= uLen; i += 16)
+        {
+            __m128i n0, n1;
+            if(!detail::HexToNibble16(_mm_loadu_si128((const __m128i*)(pSrc + i * 2)), n0)
+                || !detail::HexToNibble16(_mm_loadu_si128((const __m128i*)(pSrc + i * 2 + 16)), n1))
+            {
+                break;  // 交给标量循环定位出错字符
+            }
+            // 每16位中低字节为高半字节，高字节为低半字节
+            const __m128i lowByte = _mm_set1_epi16(0x00FF);
+            n0 = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(n0, 4), _mm_srli_epi16(n0, 8)), lowByte);
+            n1 = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(n1, 4), _mm_srli_epi16(n1, 8)), lowByte);
+            _mm_storeu_si128((__m128i*)(pDst + i), _mm_packus_epi16(n0, n1));
+        }
+#endif
+        for(; i < uLen; ++i)
+        {
+            int8_t hi = detail::tblHex.val[(unsigned char)pSrc[i * 2]];
+            int8_t lo = detail::tblHex.val[(unsigned char)pSrc[i * 2 + 1]];
+            if(hi < 0 || lo < 0)
+            {
+                output.resize(uOld);
+                if(pErrorPos)
+                {
+                    *pErrorPos = (hi < 0) ? i * 2 : i * 2 + 1;
+                }
+                return false;
+            }
+            pDst[i] = (unsigned char)((hi << 4) | lo);
+        }
+
+        if(sHex.length() % 2)
+        {
+            output.resize(uOld);
+            if(pErrorPos)
+            {
+                *pErrorPos = sHex.length() - 1;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    /** @fn inline void Base64Encode(std::string& output, const void* pData, size_t nLen)
+     *  @brief 将[pData, pData+nLen)编码为Base64追加到output，不足3字节的尾部以'='填充
+     */
+    inline void Base64Encode(std::string& output, const void* pData, size_t nLen)
+    {
+        if(0 == nLen)
+        {
+            return;
+        }
+        const unsigned char* pSrc = static_cast<const unsigned char*>(pData);
+        const char* pAlphabet = detail::chBase64;
+        size_t uOld = output.length();
+        output.resize(uOld + (nLen + 2) / 3 * 4);
+        char* pDst = &output[uOld];
+
+        size_t i = 0;
+#if defined(STRINGHELPER_SSSE3)
+        // 每次读16字节只编码其中12字节，保证不越界读
+        for(; i + 16 <= nLen; i += 12)
+        {
+            _mm_storeu_si128((__m128i*)pDst, detail::Base64Encode12(_mm_loadu_si128((const __m128i*)(pSrc + i))));
+            pDst += 16;
+        }
+#endif
+        for(; i + 3 <= nLen; i += 3)
+        {
+            uint32_t v = ((uint32_t)pSrc[i] << 16) | ((uint32_t)pSrc[i + 1] << 8) | pSrc[i + 2];
+            pDst[0] = pAlphabet[v >> 18];
+            pDst[1] = pAlphabet[(v >> 12) & 0x3F];
+            pDst[2] = pAlphabet[(v >> 6) & 0x3F];
+            pDst[3] = pAlphabet[v & 0x3F];
+            pDst += 4;
+        }
+        if(i < nLen)
+        {
+            uint32_t v = (uint32_t)pSrc[i] << 16;
+            if(i + 1 < nLen)
+            {
+                v |= (uint32_t)pSrc[i + 1] << 8;
+            }
+            pDst[0] = pAlphabet[v >> 18];
+            pDst[1] = pAlphabet[(v >> 12) & 0x3F];
+            pDst[2] = (i + 1 < nLen) ? pAlphabet[(v >> 6) & 0x3F] : '=';
+            pDst[3] = '=';
+        }
+    }
+
+    inline std::string Base64Encode(std::string_view data)
+    {
+        std::string output;
+        Base64Encode(output, data.data(), data.length());
+        return output;
+    }
+
+    /** @fn inline bool Base64Decode(std::string& output, std::string_view sBase64, size_t* pErrorPos = NULL)
+     *  @brief 将Base64串解码追加到output
+     *    严格校验：长度须为4的倍数，'='只能出现在末尾且至多两个，填充前未用到的位须为0，不允许空白
+     *  @param (OUT) size_t* pErrorPos 失败时为第一个非法字符的下标，长度不对时为末尾不完整分组的起始下标
+     *  @return bool 失败时output保持原内容
+     */
+    inline bool Base64Decode(std::string& output, std::string_view sBase64, size_t* pErrorPos = NULL)
+    {
+        const size_t uOld = output.length();
+        const size_t uLen = sBase64.length();
+        if(uLen % 4)
+        {
+            if(pErrorPos)
+            {
+                *pErrorPos = uLen - uLen % 4;
+            }
+            return false;
+        }
+        if(0 == uLen)
+        {
+            return true;
+        }
+
+        // 预留4字节给SIMD的16字节写入，最后再截到实际长度
+        output.resize(uOld + uLen / 4 * 3 + 4);
+        unsigned char* pDst = reinterpret_cast<unsigned char*>(&output[0] + uOld);
+        const char* pSrc = sBase64.data();
+        const size_t uBody = uLen - 4;     // 最后一组可能含填充
+
+        size_t i = 0;
+#if defined(STRINGHELPER_SSSE3)
+        for(; i + 16 <= uBody; i += 16)
+        {
+            __m128i out;
+            if(!detail::Base64Decode16(_mm_loadu_si128((const __m128i*)(pSrc + i)), out))
+            {
+                break;  // 交给标量循环定位出错字符
+            }
+            _mm_storeu_si128((__m128i*)pDst, out);
+            pDst += 12;
+        }
+#endif
+        for(; i < uLen; i += 4)
+        {
+            size_t uBad = 0;
+            size_t uBytes = detail::Base64DecodeQuad(pSrc + i, i == uBody, pDst, uBad);
+            if(0 == uBytes)
+            {
+                output.resize(uOld);
+                if(pErrorPos)
+                {
+                    *pErrorPos = i + uBad;
+                }
+                return false;
+            }
+            pDst += uBytes;
+        }
+
+        output.resize(pDst - reinterpret_cast<unsigned char*>(&output[0]));
+        return true;
+    }
+}
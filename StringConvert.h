@@ -0,0 +1,200 @@
+/********************************************************************
+	filename: 	StringConvert.h
+
+	purpose:	基于to_chars/from_chars的数值与字符串互转
+	            不构造stringstream、不查询locale，解析失败时明确返回错误码
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <system_error>
+#include <type_traits>
+#include "StringScan.h"
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // 可走to_chars/from_chars的类型：除bool和字符类型外的整型，以及浮点型
+        template<class T>
+        struct IsCharsConvertible : std::integral_constant<bool,
+            std::is_floating_point<T>::value
+            || (std::is_integral<T>::value
+                && !std::is_same<T, bool>::value
+                && !std::is_same<T, char>::value
+                && !std::is_same<T, signed char>::value
+                && !std::is_same<T, unsigned char>::value
+                && !std::is_same<T, wchar_t>::value
+                && !std::is_same<T, char16_t>::value
+                && !std::is_same<T, char32_t>::value)>
+        {
+        };
+
+        inline const char* SkipSpaces(const char* p, const char* pEnd)
+        {
+            while(p != pEnd && clsSpaces.Test((unsigned char)*p))
+            {
+                ++p;
+            }
+            return p;
+        }
+
+        // from_chars不接受前导'+'，这里与strtol/istream保持一致予以接受
+        template<class T>
+        inline std::from_chars_result FromChars(const char* p, const char* pEnd, T& val)
+        {
+            if(p != pEnd && *p == '+' && (pEnd - p) > 1 && p[1] != '-' && p[1] != '+')
+            {
+                ++p;
+            }
+            if constexpr (std::is_floating_point<T>::value)
+            {
+                return std::from_chars(p, pEnd, val, std::chars_format::general);
+            }
+            else
+            {
+                return std::from_chars(p, pEnd, val, 10);
+            }
+        }
+    }
+
+    /** @fn inline void AppendNumber(std::string& output, T val)
+     *  @brief 将数值追加到output，整数按十进制，浮点数输出可精确还原的最短表示
+     */
+    template<class T>
+    inline void AppendNumber(std::string& output, T val)
+    {
+        static_assert(detail::IsCharsConvertible<T>::value, "AppendNumber: T must be a non-character arithmetic type");
+        char chBuf[64];
+        std::to_chars_result res = std::to_chars(chBuf, chBuf + sizeof(chBuf), val);
+        output.append(chBuf, res.ptr - chBuf);
+    }
+
+    template<class T>
+    inline std::string NumberToString(T val)
+    {
+        std::string output;
+        AppendNumber(output, val);
+        return output;
+    }
+
+    /** @fn inline std::errc ParseNumberPrefix(std::string_view s, T& val, size_t& uConsumed)
+     *  @brief 跳过前导空白后解析最长的数值前缀，类似strtol
+     *  @param (OUT) size_t& uConsumed 成功时为数值结束处的下标（含跳过的空白）
+     *  @return std::errc 成功为std::errc()，无数值为invalid_argument，溢出为result_out_of_range；失败时val不变
+     */
+    template<class T>
+    inline std::errc ParseNumberPrefix(std::string_view s, T& val, size_t& uConsumed)
+    {
+        static_assert(detail::IsCharsConvertible<T>::value, "ParseNumberPrefix: T must be a non-character arithmetic type");
+        const char* pEnd = s.data() + s.length();
+        const char* p = detail::SkipSpaces(s.data(), pEnd);
+        std::from_chars_result res = detail::FromChars(p, pEnd, val);
+        if(res.ec == std::errc())
+        {
+            uConsumed = res.ptr - s.data();
+        }
+        return res.ec;
+    }
+
+    /** @fn inline std::errc ParseNumber(std::string_view s, T& val)
+     *  @brief 严格解析：除前后空白外，整个字符串须恰好是一个数
+     *  @return std::errc 同ParseNumberPrefix，存在多余字符时为invalid_argument；失败时val不变
+     */
+    template<class T>
+    inline std::errc ParseNumber(std::string_view s, T& val)
+    {
+        T tmp = T();
+        size_t uConsumed = 0;
+        std::errc ec = ParseNumberPrefix(s, tmp, uConsumed);
+        if(ec != std::errc())
+        {
+            return ec;
+        }
+        const char* pEnd = s.data() + s.length();
+        if(detail::SkipSpaces(s.data() + uConsumed, pEnd) != pEnd)
+        {
+            return std::errc::invalid_argument;
+        }
+        val = tmp;
+        return std::errc();
+    }
+
+    /** @fn inline std::errc ParseNumbers(std::string_view s, char sep, std::vector<T>& vecOut, size_t* pErrorPos = NULL)
+     *  @brief 批量解析分隔的数值并追加到vecOut
+     *    sep为空白字符时按连续空白分隔；否则按单个sep分隔，数值两侧的空白被忽略，空字段视为错误
+     *    全空白的输入得到0个数值
+     *  @param (OUT) size_t* pErrorPos 出错时为出错字段的起始下标
+     *  @return std::errc 出错时vecOut保留出错前已解析的数值
+     */
+    template<class T>
+    inline std::errc ParseNumbers(std::string_view s, char sep, std::vector<T>& vecOut, size_t* pErrorPos = NULL)
+    {
+        static_assert(detail::IsCharsConvertible<T>::value, "ParseNumbers: T must be a non-character arithmetic type");
+        const char* pBegin = s.data();
+        const char* pEnd = pBegin + s.length();
+        const bool bSpaceSep = clsSpaces.Test((unsigned char)sep);
+
+        const char* p = detail::SkipSpaces(pBegin, pEnd);
+        if(p == pEnd)
+        {
+            return std::errc();
+        }
+
+        while(true)
+        {
+            const char* pField = p;
+            T val = T();
+            std::from_chars_result res = detail::FromChars(p, pEnd, val);
+            std::errc ec = res.ec;
+            p = res.ptr;
+            if(ec == std::errc())
+            {
+                if(bSpaceSep)
+                {
+                    if(p != pEnd && !clsSpaces.Test((unsigned char)*p))
+                    {
+                        ec = std::errc::invalid_argument;
+                    }
+                }
+                else
+                {
+                    p = detail::SkipSpaces(p, pEnd);
+                    if(p != pEnd && *p != sep)
+                    {
+                        ec = std::errc::invalid_argument;
+                    }
+                }
+            }
+            if(ec != std::errc())
+            {
+                if(pErrorPos)
+                {
+                    *pErrorPos = pField - pBegin;
+                }
+                return ec;
+            }
+
+            vecOut.push_back(val);
+            if(bSpaceSep)
+            {
+                p = detail::SkipSpaces(p, pEnd);
+                if(p == pEnd)
+                {
+                    break;
+                }
+            }
+            else
+            {
+                if(p == pEnd)
+                {
+                    break;
+                }
+                p = detail::SkipSpaces(p + 1, pEnd);
+            }
+        }
+        return std::errc();
+    }
+}
@@ -0,0 +1,479 @@
+/********************************************************************
+	filename: 	StringEncoding.h
+
+	purpose:	UTF-8校验及GBK与UTF-8互转，不依赖系统代码页API
+	            UTF-8校验在SSSE3下每16字节查表判断（Keiser-Lemire算法），
+	            其余情况逐字符判断；各函数都先整段跳过ASCII
+	            GBK按CP936处理：0x80为欧元符号，用户自定义区视为未定义
+	            映射表约48KB，只有包含本文件的编译单元才会编入
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+#include "StringScan.h"
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        enum
+        {
+            GBK_TRAIL_COUNT = 190,      // 每个首字节对应的尾字节个数
+            GBK_EURO        = 0x80,     // CP936单字节欧元符号
+            UNICODE_EURO    = 0x20AC,
+        };
+
+        inline const uint16_t* GbkToUnicodeTable()
+        {
+            static const uint16_t s_table[(0xFE - 0x81 + 1) * GBK_TRAIL_COUNT] =
+            {
+#include "GbkTable.inc"
+            };
+            return s_table;
+        }
+
+        // Unicode(BMP)到GBK的反查表由正向表展开，首次使用时构造
+        struct CUnicodeToGbkTable
+        {
+            uint16_t val[0x10000];
+
+            CUnicodeToGbkTable()
+                : val()
+            {
+                const uint16_t* pForward = GbkToUnicodeTable();
+                for(unsigned int uLead = 0x81; uLead <= 0xFE; ++uLead)
+                {
+                    for(unsigned int k = 0; k < GBK_TRAIL_COUNT; ++k)
+                    {
+                        uint16_t uCode = pForward[(uLead - 0x81) * GBK_TRAIL_COUNT + k];
+                        if(uCode)
+                        {
+                            unsigned int uTrail = (k < 0x3F) ? 0x40 + k : 0x41 + k;
+                            val[uCode] = (uint16_t)((uLead << 8) | uTrail);
+                        }
+                    }
+                }
+            }
+        };
+
+        inline const CUnicodeToGbkTable& UnicodeToGbkTable()
+        {
+            static const CUnicodeToGbkTable* s_pTable = new CUnicodeToGbkTable;
+            return *s_pTable;
+        }
+
+        // 双字节GBK码对应的Unicode，未定义返回0
+        inline uint16_t GbkToUnicode(unsigned char chLead, unsigned char chTrail)
+        {
+            if(chLead < 0x81 || chLead > 0xFE || chTrail < 0x40 || chTrail > 0xFE || chTrail == 0x7F)
+            {
+                return 0;
+            }
+            unsigned int k = (chTrail < 0x7F) ? chTrail - 0x40 : chTrail - 0x41;
+            return GbkToUnicodeTable()[(chLead - 0x81) * GBK_TRAIL_COUNT + k];
+        }
+
+        /** @fn inline size_t AsciiPrefixLength(const char* p, size_t n)
+         *  @brief [p, p+n)开头连续ASCII字节的个数
+         */
+        inline size_t AsciiPrefixLength(const char* p, size_t n)
+        {
+            size_t i = 0;
+#if defined(STRINGHELPER_AVX2)
+            for(; i + 32 <= n; i += 32)
+            {
+                uint32_t uMask = (uint32_t)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(p + i)));
+                if(uMask)
+                {
+                    return i + LowestBit(uMask);
+                }
+            }
+#endif
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            for(; i + 16 <= n; i += 16)
+            {
+                uint32_t uMask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i)));
+                if(uMask)
+                {
+                    return i + LowestBit(uMask);
+                }
+            }
+#endif
+            for(; i + 8 <= n; i += 8)
+            {
+                uint64_t w;
+                memcpy(&w, p + i, sizeof(w));
+                if(w & 0x8080808080808080ULL)
+                {
+                    break;
+                }
+            }
+            while(i < n && (signed char)p[i] >= 0)
+            {
+                ++i;
+            }
+            return i;
+        }
+
+        /** @fn inline size_t DecodeUtf8(const unsigned char* p, size_t n, uint32_t& uCode)
+         *  @brief 解码p处的一个非ASCII的UTF-8字符，拒绝过长编码、代理项及超出U+10FFFF的码点
+         *  @return size_t 字符的字节数(2-4)，不合法或被截断时返回0
+         */
+        inline size_t DecodeUtf8(const unsigned char* p, size_t n, uint32_t& uCode)
+        {
+            unsigned char c = p[0];
+            size_t uLen = 0;
+            unsigned char chMin = 0x80;     // 第二字节的合法范围
+            unsigned char chMax = 0xBF;
+            if(c >= 0xC2 && c <= 0xDF)
+            {
+                uLen = 2;
+                uCode = c & 0x1F;
+            }
+            else if(c >= 0xE0 && c <= 0xEF)
+            {
+                uLen = 3;
+                uCode = c & 0x0F;
+                chMin = (c == 0xE0) ? 0xA0 : 0x80;
+                chMax = (c == 0xED) ? 0x9F : 0xBF;
+            }
+            else if(c >= 0xF0 && c <= 0xF4)
+            {
+                uLen = 4;
+                uCode = c & 0x07;
+                chMin = (c == 0xF0) ? 0x90 : 0x80;
+                chMax = (c == 0xF4) ? 0x8F : 0xBF;
+            }
+            else
+            {
+                return 0;
+            }
+
+            if(n < uLen || p[1] < chMin || p[1] > chMax)
+            {
+                return 0;
+            }
+            for(size_t k = 1; k < uLen; ++k)
+            {
+                if((p[k] & 0xC0) != 0x80)
+                {
+                    return 0;
+                }
+                uCode = (uCode << 6) | (p[k] & 0x3F);
+            }
+            return uLen;
+        }
+
+        inline void AppendUtf8(std::string& output, uint32_t uCode)
+        {
+            if(uCode < 0x80)
+            {
+                output.push_back((char)uCode);
+            }
+            else if(uCode < 0x800)
+            {
+                char chBuf[2] = {(char)(0xC0 | (uCode >> 6)), (char)(0x80 | (uCode & 0x3F))};
+                output.append(chBuf, 2);
+            }
+            else if(uCode < 0x10000)
+            {
+                char chBuf[3] = {(char)(0xE0 | (uCode >> 12)), (char)(0x80 | ((uCode >> 6) & 0x3F)), (char)(0x80 | (uCode & 0x3F))};
+                output.append(chBuf, 3);
+            }
+            else
+            {
+                char chBuf[4] = {(char)(0xF0 | (uCode >> 18)), (char)(0x80 | ((uCode >> 12) & 0x3F)),
+                    (char)(0x80 | ((uCode >> 6) & 0x3F)), (char)(0x80 | (uCode & 0x3F))};
+                output.append(chBuf, 4);
+            }
+        }
+
+        // 从i处逐字符校验，返回第一个非法字符的起始下标，全部合法返回npos
+        inline size_t Utf8ErrorScalar(const char* p, size_t n, size_t i)
+        {
+            while(true)
+            {
+                i += AsciiPrefixLength(p + i, n - i);
+                if(i >= n)
+                {
+                    return std::string_view::npos;
+                }
+                uint32_t uCode = 0;
+                size_t uLen = DecodeUtf8(reinterpret_cast<const unsigned char*>(p + i), n - i, uCode);
+                if(0 == uLen)
+                {
+                    return i;
+                }
+                i += uLen;
+            }
+        }
+
+#if defined(STRINGHELPER_SSSE3)
+        // 16字节块的UTF-8错误标记，prev为上一块，非零即有错
+        // 用前一字节的高、低半字节和本字节的高半字节各查一张表，三者相与得到两字节组合的错误，
+        // 再与“应为第3、4字节”的位置比对，检查续字节个数
+        inline __m128i Utf8BlockErrors(__m128i input, __m128i prev)
+        {
+            const char TOO_SHORT = 1 << 0;      // 首字节后跟ASCII或另一个首字节
+            const char TOO_LONG = 1 << 1;       // ASCII后跟续字节
+            const char OVERLONG_3 = 1 << 2;
+            const char TOO_LARGE = 1 << 3;
+            const char SURROGATE = 1 << 4;
+            const char OVERLONG_2 = 1 << 5;
+            const char TOO_LARGE_1000 = 1 << 6;
+            const char OVERLONG_4 = 1 << 6;
+            const char TWO_CONTS = (char)(1 << 7);    // 续字节后跟续字节，只在非第3、4字节处是错误
+            const char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+            const __m128i lutByte1High = _mm_setr_epi8(
+                TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                TOO_SHORT | OVERLONG_2,
+                TOO_SHORT,
+                TOO_SHORT | OVERLONG_3 | SURROGATE,
+                TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+            const __m128i lutByte1Low = _mm_setr_epi8(
+                CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+                CARRY | OVERLONG_2,
+                CARRY,
+                CARRY,
+                CARRY | TOO_LARGE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000);
+            const __m128i lutByte2High = _mm_setr_epi8(
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+            const __m128i nibble = _mm_set1_epi8(0x0F);
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i special = _mm_and_si128(
+                _mm_and_si128(_mm_shuffle_epi8(lutByte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                    _mm_shuffle_epi8(lutByte1Low, _mm_and_si128(prev1, nibble))),
+                _mm_shuffle_epi8(lutByte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+
+            // 前2字节为3/4字节首字节、或前3字节为4字节首字节时，本字节必须是续字节
+            __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+            __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))),
+                _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+            return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char)0x80)), special);
+        }
+#endif
+
+        /** @fn inline size_t Utf8ErrorOffset(const char* p, size_t n)
+         *  @brief 返回第一个非法(或被截断)字符的起始下标，全部合法返回npos
+         *    SIMD逐块判断，发现错误后从出错块之前最近的字符边界起改用标量定位
+         */
+        inline size_t Utf8ErrorOffset(const char* p, size_t n)
+        {
+            size_t i = 0;
+#if defined(STRINGHELPER_SSSE3)
+            const __m128i zero = _mm_setzero_si128();
+            // 最后3字节若为尚未结束的多字节首字节，则下一块开头必须是续字节
+            const __m128i maxComplete = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+            __m128i prev = zero;
+            __m128i prevIncomplete = zero;
+            for(; i + 16 <= n; i += 16)
+            {
+                __m128i input = _mm_loadu_si128((const __m128i*)(p + i));
+                __m128i error;
+                if(0 == _mm_movemask_epi8(input))
+                {
+                    error = prevIncomplete;
+                }
+                else
+                {
+                    error = Utf8BlockErrors(input, prev);
+                    prevIncomplete = _mm_subs_epu8(input, maxComplete);
+                }
+                if(_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xFFFF)
+                {
+                    break;
+                }
+                prev = input;
+            }
+
+            // 出错的块或不足16字节的尾部交给标量，前一块末尾可能有跨块的字符，回退到其首字节
+            size_t uStart = (i >= 3) ? i - 3 : 0;
+            while(uStart < i && ((unsigned char)p[uStart] & 0xC0) == 0x80)
+            {
+                ++uStart;
+            }
+            i = uStart;
+#endif
+            return Utf8ErrorScalar(p, n, i);
+        }
+
+        template<bool bLossy>
+        inline bool GbkToUtf8Impl(std::string& output, std::string_view sGbk, size_t* pErrorPos)
+        {
+            const size_t uOld = output.length();
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(sGbk.data());
+            const size_t n = sGbk.length();
+            output.reserve(uOld + n + n / 2);  // 汉字2字节变3字节
+
+            size_t i = 0;
+            while(true)
+            {
+                size_t uAscii = AsciiPrefixLength(sGbk.data() + i, n - i);
+                output.append(sGbk.data() + i, uAscii);
+                i += uAscii;
+                if(i >= n)
+                {
+                    return true;
+                }
+
+                if(GBK_EURO == p[i])
+                {
+                    AppendUtf8(output, UNICODE_EURO);
+                    i += 1;
+                    continue;
+                }
+                uint16_t uCode = (i + 1 < n) ? GbkToUnicode(p[i], p[i + 1]) : 0;
+                if(uCode)
+                {
+                    AppendUtf8(output, uCode);
+                    i += 2;
+                    continue;
+                }
+
+                if(!bLossy)
+                {
+                    output.resize(uOld);
+                    if(pErrorPos)
+                    {
+                        *pErrorPos = i;
+                    }
+                    return false;
+                }
+                // 结构合法但未定义的双字节码整体替换，否则只跳过一个字节以便重新同步
+                bool bPair = p[i] >= 0x81 && p[i] <= 0xFE && i + 1 < n
+                    && p[i + 1] >= 0x40 && p[i + 1] <= 0xFE && p[i + 1] != 0x7F;
+                output.append("\xEF\xBF\xBD", 3);
+                i += bPair ? 2 : 1;
+            }
+        }
+
+        template<bool bLossy>
+        inline bool Utf8ToGbkImpl(std::string& output, std::string_view sUtf8, size_t* pErrorPos)
+        {
+            const size_t uOld = output.length();
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(sUtf8.data());
+            const size_t n = sUtf8.length();
+            const CUnicodeToGbkTable& table = UnicodeToGbkTable();
+            output.reserve(uOld + n);
+
+            size_t i = 0;
+            while(true)
+            {
+                size_t uAscii = AsciiPrefixLength(sUtf8.data() + i, n - i);
+                output.append(sUtf8.data() + i, uAscii);
+                i += uAscii;
+                if(i >= n)
+                {
+                    return true;
+                }
+
+                uint32_t uCode = 0;
+                size_t uLen = DecodeUtf8(p + i, n - i, uCode);
+                uint16_t uGbk = 0;
+                if(uLen)
+                {
+                    uGbk = (UNICODE_EURO == uCode) ? (uint16_t)GBK_EURO : (uCode < 0x10000 ? table.val[uCode] : 0);
+                }
+                if(uGbk > 0xFF)
+                {
+                    char chBuf[2] = {(char)(uGbk >> 8), (char)(uGbk & 0xFF)};
+                    output.append(chBuf, 2);
+                    i += uLen;
+                    continue;
+                }
+                if(uGbk)
+                {
+                    output.push_back((char)uGbk);
+                    i += uLen;
+                    continue;
+                }
+
+                if(!bLossy)
+                {
+                    output.resize(uOld);
+                    if(pErrorPos)
+                    {
+                        *pErrorPos = i;
+                    }
+                    return false;
+                }
+                // GBK中没有的字符整体替换为'?'，非法字节逐个替换
+                output.push_back('?');
+                i += uLen ? uLen : 1;
+            }
+        }
+    }
+
+    /** @fn inline bool IsValidUtf8(std::string_view s, size_t* pErrorPos = NULL)
+     *  @brief 严格校验UTF-8：拒绝过长编码、代理项(U+D800-DFFF)、超出U+10FFFF及被截断的字符
+     *  @param (OUT) size_t* pErrorPos 非法时为第一个非法字符的起始下标
+     */
+    inline bool IsValidUtf8(std::string_view s, size_t* pErrorPos = NULL)
+    {
+        size_t uPos = detail::Utf8ErrorOffset(s.data(), s.length());
+        if(std::string_view::npos == uPos)
+        {
+            return true;
+        }
+        if(pErrorPos)
+        {
+            *pErrorPos = uPos;
+        }
+        return false;
+    }
+
+    /** @fn inline bool GbkToUtf8(std::string& output, std::string_view sGbk, size_t* pErrorPos = NULL)
+     *  @brief GBK转UTF-8并追加到output
+     *  @param (OUT) size_t* pErrorPos 失败时为第一个无法转换的字节的下标
+     *  @return bool 遇到非法或未定义的GBK码时返回false，output保持原内容
+     */
+    inline bool GbkToUtf8(std::string& output, std::string_view sGbk, size_t* pErrorPos = NULL)
+    {
+        return detail::GbkToUtf8Impl<false>(output, sGbk, pErrorPos);
+    }
+
+    /** @fn inline bool Utf8ToGbk(std::string& output, std::string_view sUtf8, size_t* pErrorPos = NULL)
+     *  @brief UTF-8转GBK并追加到output
+     *  @param (OUT) size_t* pErrorPos 失败时为第一个非法或GBK中没有的字符的起始下标
+     *  @return bool 失败时output保持原内容
+     */
+    inline bool Utf8ToGbk(std::string& output, std::string_view sUtf8, size_t* pErrorPos = NULL)
+    {
+        return detail::Utf8ToGbkImpl<false>(output, sUtf8, pErrorPos);
+    }
+
+    // 宽松转换，用于日志等不能因个别坏字节失败的场合：无法转换的部分替换为U+FFFD
+    inline void GbkToUtf8Lossy(std::string& output, std::string_view sGbk)
+    {
+        detail::GbkToUtf8Impl<true>(output, sGbk, NULL);
+    }
+
+    // 宽松转换，无法转换的部分替换为'?'
+    inline void Utf8ToGbkLossy(std::string& output, std::string_view sUtf8)
+    {
+        detail::Utf8ToGbkImpl<true>(output, sUtf8, NULL);
+    }
+}
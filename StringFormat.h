@@ -0,0 +1,652 @@
+/********************************************************************
+	filename: 	StringFormat.h
+
+	purpose:	编译期检查的类型安全格式化，替代基于vsnprintf的Format系列
+	            格式串须用STRFMT包装，格式串解析与参数类型检查均在编译期完成：
+	                std::string s = StringHelper::Format(STRFMT("%s: %d/%g"), name, n, d);
+	                StringHelper::AppendString(out, STRFMT("%-8s|%08.3f\n"), key, val);
+	            支持printf的标志(-+ #0)、宽度、精度及长度修饰符(被忽略)，
+	            转换符支持d i u o x X c s f F e E g G p；不支持*宽度/精度
+	            数值格式化基于std::to_chars，不查询locale，结果与"C" locale下的printf一致
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <array>
+#include <charconv>
+#include <type_traits>
+#include <stdint.h>
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // STRFMT生成的格式串类型的基类，用于与const char*版本的重载区分
+        struct CFormatLiteralTag
+        {
+        };
+
+        enum FormatError
+        {
+            FMT_OK = 0,
+            FMT_BAD_CONVERSION,     // 不支持的转换符
+            FMT_STAR_UNSUPPORTED,   // 不支持*宽度/精度
+            FMT_DANGLING_PERCENT,   // 格式串以不完整的%结尾
+        };
+
+        enum FormatFlag
+        {
+            FMT_FLAG_LEFT   = 0x01,
+            FMT_FLAG_PLUS   = 0x02,
+            FMT_FLAG_SPACE  = 0x04,
+            FMT_FLAG_ALT    = 0x08,
+            FMT_FLAG_ZERO   = 0x10,
+        };
+
+        // 格式串片段：chConv为0时是字面量[uBegin, uBegin+uLen)，否则是一个参数
+        struct FormatPiece
+        {
+            uint32_t    uBegin;
+            uint32_t    uLen;
+            char        chConv;
+            uint8_t     uFlags;
+            int32_t     nWidth;
+            int32_t     nPrecision;     // -1表示未指定
+            uint32_t    uArgIndex;
+        };
+
+        template<size_t N>
+        struct FormatParse
+        {
+            std::array<FormatPiece, N>  pieces;
+            size_t                      nPieces;
+            size_t                      nArgs;
+            FormatError                 error;
+        };
+
+        constexpr bool IsFormatDigit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        constexpr bool IsFormatConversion(char c)
+        {
+            return std::string_view("diouxXcsfFeEgGp").find(c) != std::string_view::npos;
+        }
+
+        template<size_t N>
+        constexpr void AddFormatPiece(FormatParse<N>& result, const FormatPiece& piece)
+        {
+            if(result.nPieces < N)
+            {
+                result.pieces[result.nPieces] = piece;
+            }
+            ++result.nPieces;
+        }
+
+        /** @fn constexpr FormatParse<N> ParseFormat(std::string_view fmt)
+         *  @brief 编译期解析格式串，N为0时只统计片段数
+         */
+        template<size_t N>
+        constexpr FormatParse<N> ParseFormat(std::string_view fmt)
+        {
+            FormatParse<N> result = {};
+            size_t uLitBegin = 0;
+            size_t i = 0;
+            while(i < fmt.length())
+            {
+                if(fmt[i] != '%')
+                {
+                    ++i;
+                    continue;
+                }
+
+                if(i > uLitBegin)
+                {
+                    AddFormatPiece(result, FormatPiece{(uint32_t)uLitBegin, (uint32_t)(i - uLitBegin), 0, 0, 0, -1, 0});
+                }
+
+                // %%输出一个%
+                if(i + 1 < fmt.length() && fmt[i + 1] == '%')
+                {
+                    AddFormatPiece(result, FormatPiece{(uint32_t)i, 1, 0, 0, 0, -1, 0});
+                    i += 2;
+                    uLitBegin = i;
+                    continue;
+                }
+
+                FormatPiece piece = {0, 0, 0, 0, 0, -1, (uint32_t)result.nArgs};
+                ++i;
+                for(; i < fmt.length(); ++i)
+                {
+                    char c = fmt[i];
+                    if(c == '-')      piece.uFlags |= FMT_FLAG_LEFT;
+                    else if(c == '+') piece.uFlags |= FMT_FLAG_PLUS;
+                    else if(c == ' ') piece.uFlags |= FMT_FLAG_SPACE;
+                    else if(c == '#') piece.uFlags |= FMT_FLAG_ALT;
+                    else if(c == '0') piece.uFlags |= FMT_FLAG_ZERO;
+                    else break;
+                }
+                for(; i < fmt.length() && IsFormatDigit(fmt[i]); ++i)
+                {
+                    piece.nWidth = piece.nWidth * 10 + (fmt[i] - '0');
+                }
+                if(i < fmt.length() && fmt[i] == '.')
+                {
+                    piece.nPrecision = 0;
+                    for(++i; i < fmt.length() && IsFormatDigit(fmt[i]); ++i)
+                    {
+                        piece.nPrecision = piece.nPrecision * 10 + (fmt[i] - '0');
+                    }
+                }
+                if(i < fmt.length() && fmt[i] == '*')
+                {
+                    result.error = FMT_STAR_UNSUPPORTED;
+                    return result;
+                }
+                // 长度修饰符对类型安全的格式化没有意义，跳过
+                while(i < fmt.length() && std::string_view("hlLqjzt").find(fmt[i]) != std::string_view::npos)
+                {
+                    ++i;
+                }
+                if(i < fmt.length() && fmt[i] == 'I')
+                {
+                    ++i;
+                    if(fmt.substr(i, 2) == "64" || fmt.substr(i, 2) == "32")
+                    {
+                        i += 2;
+                    }
+                }
+                if(i >= fmt.length())
+                {
+                    result.error = FMT_DANGLING_PERCENT;
+                    return result;
+                }
+                if(!IsFormatConversion(fmt[i]))
+                {
+                    result.error = FMT_BAD_CONVERSION;
+                    return result;
+                }
+
+                piece.chConv = fmt[i++];
+                AddFormatPiece(result, piece);
+                ++result.nArgs;
+                uLitBegin = i;
+            }
+
+            if(fmt.length() > uLitBegin)
+            {
+                AddFormatPiece(result, FormatPiece{(uint32_t)uLitBegin, (uint32_t)(fmt.length() - uLitBegin), 0, 0, 0, -1, 0});
+            }
+            return result;
+        }
+
+        // 编译后的格式串，F为STRFMT生成的类型
+        template<class F>
+        struct CCompiledFormat
+        {
+            static constexpr std::string_view       fmt     = F::Get();
+            static constexpr FormatParse<0>         summary = ParseFormat<0>(fmt);
+            static constexpr FormatParse<summary.nPieces> parse = ParseFormat<summary.nPieces>(fmt);
+        };
+
+        enum ArgKind
+        {
+            ARG_NONE = 0,
+            ARG_INT,
+            ARG_UINT,
+            ARG_CHAR,
+            ARG_DOUBLE,
+            ARG_STRING,
+            ARG_POINTER,
+        };
+
+        template<class T, class = void>
+        struct ArgKindOf
+        {
+            static constexpr ArgKind value = ARG_NONE;
+        };
+
+        template<class T>
+        struct ArgKindOf<T, typename std::enable_if<std::is_integral<T>::value>::type>
+        {
+            static constexpr ArgKind value = std::is_same<T, char>::value ? ARG_CHAR
+                : (std::is_signed<T>::value || std::is_same<T, bool>::value) ? ARG_INT : ARG_UINT;
+        };
+
+        template<class T>
+        struct ArgKindOf<T, typename std::enable_if<std::is_enum<T>::value>::type>
+        {
+            static constexpr ArgKind value = std::is_signed<typename std::underlying_type<T>::type>::value ? ARG_INT : ARG_UINT;
+        };
+
+        template<class T>
+        struct ArgKindOf<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+        {
+            static constexpr ArgKind value = ARG_DOUBLE;
+        };
+
+        template<class T>
+        struct ArgKindOf<T, typename std::enable_if<std::is_pointer<T>::value>::type>
+        {
+            static constexpr ArgKind value = std::is_same<typename std::remove_cv<typename std::remove_pointer<T>::type>::type, char>::value
+                ? ARG_STRING : ARG_POINTER;
+        };
+
+        template<>
+        struct ArgKindOf<std::string>
+        {
+            static constexpr ArgKind value = ARG_STRING;
+        };
+
+        template<>
+        struct ArgKindOf<std::string_view>
+        {
+            static constexpr ArgKind value = ARG_STRING;
+        };
+
+        template<>
+        struct ArgKindOf<std::nullptr_t>
+        {
+            static constexpr ArgKind value = ARG_POINTER;
+        };
+
+        constexpr bool IsArgCompatible(char chConv, ArgKind kind)
+        {
+            switch(chConv)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                return kind == ARG_INT || kind == ARG_UINT || kind == ARG_CHAR;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                return kind == ARG_DOUBLE;
+            case 's':
+                return kind == ARG_STRING;
+            case 'p':
+                return kind == ARG_POINTER || kind == ARG_STRING;
+            default:
+                return false;
+            }
+        }
+
+        /** @fn constexpr int FindMismatchedArg()
+         *  @brief 返回第一个与转换符不匹配的参数下标，全部匹配时返回-1
+         */
+        template<class F, class... Args>
+        constexpr int FindMismatchedArg()
+        {
+            constexpr ArgKind kinds[] = {ARG_NONE, ArgKindOf<typename std::decay<Args>::type>::value...};
+            const auto& parse = CCompiledFormat<F>::parse;
+            for(size_t i = 0; i < parse.nPieces; ++i)
+            {
+                const FormatPiece& piece = parse.pieces[i];
+                if(piece.chConv != 0 && piece.uArgIndex < sizeof...(Args)
+                    && !IsArgCompatible(piece.chConv, kinds[piece.uArgIndex + 1]))
+                {
+                    return (int)piece.uArgIndex;
+                }
+            }
+            return -1;
+        }
+
+        // 运行期的参数，类型已在编译期检查过
+        struct FormatArg
+        {
+            ArgKind             kind;
+            long long           iVal;
+            unsigned long long  uVal;
+            double              dVal;
+            std::string_view    sVal;
+            const void*         pVal;
+        };
+
+        template<class T>
+        inline FormatArg MakeFormatArg(const T& val)
+        {
+            FormatArg arg = {ArgKindOf<T>::value, 0, 0, 0.0, std::string_view(), NULL};
+            if constexpr (std::is_enum<T>::value)
+            {
+                typedef typename std::underlying_type<T>::type Underlying;
+                arg.iVal = (long long)(Underlying)val;
+                arg.uVal = (unsigned long long)(typename std::make_unsigned<Underlying>::type)val;
+            }
+            else if constexpr (std::is_integral<T>::value)
+            {
+                // 与printf一致：先做整型提升，%u/%x/%o按提升后类型的宽度解释负数
+                typedef decltype(+val) Promoted;
+                arg.iVal = (long long)val;
+                arg.uVal = (unsigned long long)(typename std::make_unsigned<Promoted>::type)val;
+            }
+            else if constexpr (std::is_floating_point<T>::value)
+            {
+                arg.dVal = (double)val;
+            }
+            else if constexpr (std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value)
+            {
+                arg.sVal = val;
+                arg.pVal = val.data();
+            }
+            else if constexpr (ArgKindOf<T>::value == ARG_STRING)
+            {
+                arg.sVal = val ? std::string_view(val) : std::string_view("(null)");
+                arg.pVal = val;
+            }
+            else
+            {
+                arg.pVal = (const void*)val;
+            }
+            return arg;
+        }
+
+        // 按宽度与标志输出：body = [sign][prefix][digits]，零填充插在prefix之后
+        template<class Output>
+        inline void AppendPadded(Output& output, const FormatPiece& piece,
+            std::string_view sign, std::string_view prefix, std::string_view body, bool bAllowZeroPad)
+        {
+            size_t uLen = sign.length() + prefix.length() + body.length();
+            size_t uPad = (piece.nWidth > 0 && (size_t)piece.nWidth > uLen) ? piece.nWidth - uLen : 0;
+            if(piece.uFlags & FMT_FLAG_LEFT)
+            {
+                output.append(sign).append(prefix).append(body).append(uPad, ' ');
+            }
+            else if(bAllowZeroPad && (piece.uFlags & FMT_FLAG_ZERO))
+            {
+                output.append(sign).append(prefix).append(uPad, '0').append(body);
+            }
+            else
+            {
+                output.append(uPad, ' ').append(sign).append(prefix).append(body);
+            }
+        }
+
+        template<class Output>
+        inline void AppendInteger(Output& output, const FormatPiece& piece, const FormatArg& arg)
+        {
+            char chBuf[72];
+            char* pBegin = chBuf + 2;  // 预留位置给精度补零前的符号处理
+            std::string_view sign;
+            std::string_view prefix;
+            unsigned long long uVal = arg.uVal;
+            bool bNegative = false;
+            int nBase = 10;
+
+            switch(piece.chConv)
+            {
+            case 'd': case 'i':
+                if(arg.kind != ARG_UINT && arg.iVal < 0)
+                {
+                    bNegative = true;
+                    uVal = 0ULL - (unsigned long long)arg.iVal;
+                }
+                break;
+            case 'o':
+                nBase = 8;
+                break;
+            case 'x': case 'X':
+                nBase = 16;
+                break;
+            default:
+                break;
+            }
+
+            std::to_chars_result res = std::to_chars(pBegin, chBuf + sizeof(chBuf), uVal, nBase);
+            std::string_view digits(pBegin, res.ptr - pBegin);
+            // printf中精度为0且值为0时不输出数字
+            if(0 == piece.nPrecision && 0 == uVal)
+            {
+                digits = std::string_view();
+            }
+            if(piece.chConv == 'X')
+            {
+                for(char* p = pBegin; p != res.ptr; ++p)
+                {
+                    if(*p >= 'a' && *p <= 'f')
+                    {
+                        *p = (char)(*p - 'a' + 'A');
+                    }
+                }
+            }
+
+            if(bNegative)
+            {
+                sign = "-";
+            }
+            else if(piece.chConv == 'd' || piece.chConv == 'i')
+            {
+                if(piece.uFlags & FMT_FLAG_PLUS)
+                {
+                    sign = "+";
+                }
+                else if(piece.uFlags & FMT_FLAG_SPACE)
+                {
+                    sign = " ";
+                }
+            }
+
+            if(piece.uFlags & FMT_FLAG_ALT)
+            {
+                if(piece.chConv == 'x' && 0 != uVal)
+                {
+                    prefix = "0x";
+                }
+                else if(piece.chConv == 'X' && 0 != uVal)
+                {
+                    prefix = "0X";
+                }
+                else if(piece.chConv == 'o' && (digits.empty() || digits[0] != '0')
+                    && (piece.nPrecision < 0 || (size_t)piece.nPrecision <= digits.length()))
+                {
+                    prefix = "0";
+                }
+            }
+
+            // 指定精度时为最少数字位数，且零填充标志失效
+            if(piece.nPrecision > 0 && (size_t)piece.nPrecision > digits.length())
+            {
+                std::string sDigits((size_t)piece.nPrecision - digits.length(), '0');
+                sDigits.append(digits);
+                AppendPadded(output, piece, sign, prefix, sDigits, false);
+                return;
+            }
+            AppendPadded(output, piece, sign, prefix, digits, piece.nPrecision < 0);
+        }
+
+        template<class Output>
+        inline void AppendFloating(Output& output, const FormatPiece& piece, double dVal)
+        {
+            std::chars_format fmt = std::chars_format::general;
+            switch(piece.chConv)
+            {
+            case 'f': case 'F':
+                fmt = std::chars_format::fixed;
+                break;
+            case 'e': case 'E':
+                fmt = std::chars_format::scientific;
+                break;
+            default:
+                break;
+            }
+            int nPrecision = piece.nPrecision < 0 ? 6 : piece.nPrecision;
+
+            char chBuf[128];
+            std::string sLarge;
+            char* pBegin = chBuf;
+            std::to_chars_result res = std::to_chars(chBuf, chBuf + sizeof(chBuf), dVal, fmt, nPrecision);
+            while(res.ec != std::errc())
+            {
+                sLarge.resize(sLarge.empty() ? 512 : sLarge.length() * 2);
+                pBegin = &sLarge[0];
+                res = std::to_chars(pBegin, pBegin + sLarge.length(), dVal, fmt, nPrecision);
+            }
+
+            std::string_view body(pBegin, res.ptr - pBegin);
+            std::string_view sign;
+            if(!body.empty() && body[0] == '-')
+            {
+                sign = "-";
+                body.remove_prefix(1);
+            }
+            else if(piece.uFlags & FMT_FLAG_PLUS)
+            {
+                sign = "+";
+            }
+            else if(piece.uFlags & FMT_FLAG_SPACE)
+            {
+                sign = " ";
+            }
+
+            bool bFinite = !body.empty() && IsFormatDigit(body[0]);
+            if(piece.chConv == 'F' || piece.chConv == 'E' || piece.chConv == 'G')
+            {
+                for(char* p = (char*)body.data(); p != res.ptr; ++p)
+                {
+                    if(*p >= 'a' && *p <= 'z')
+                    {
+                        *p = (char)(*p - 'a' + 'A');
+                    }
+                }
+            }
+
+            // '#'：精度为0时也保留小数点，%g不去除末尾的0
+            std::string sAlt;
+            if((piece.uFlags & FMT_FLAG_ALT) && bFinite)
+            {
+                sAlt.assign(body);
+                size_t uExp = sAlt.find_first_of("eE");
+                std::string sExp;
+                if(std::string::npos != uExp)
+                {
+                    sExp = sAlt.substr(uExp);
+                    sAlt.erase(uExp);
+                }
+                if(std::string::npos == sAlt.find('.'))
+                {
+                    sAlt += '.';
+                }
+                if(piece.chConv == 'g' || piece.chConv == 'G')
+                {
+                    size_t uDigits = 0;
+                    size_t uFirst = sAlt.find_first_not_of("0.");
+                    for(size_t k = (std::string::npos == uFirst ? 0 : uFirst); k < sAlt.length(); ++k)
+                    {
+                        uDigits += IsFormatDigit(sAlt[k]) ? 1 : 0;
+                    }
+                    size_t uWant = (0 == nPrecision) ? 1 : nPrecision;
+                    if(std::string::npos == uFirst)
+                    {
+                        uDigits = 1;
+                    }
+                    if(uWant > uDigits)
+                    {
+                        sAlt.append(uWant - uDigits, '0');
+                    }
+                }
+                sAlt += sExp;
+                body = sAlt;
+            }
+
+            AppendPadded(output, piece, sign, std::string_view(), body, bFinite);
+        }
+
+        template<class Output>
+        inline void AppendFormatArg(Output& output, const FormatPiece& piece, const FormatArg& arg)
+        {
+            switch(piece.chConv)
+            {
+            case 'c':
+                {
+                    char ch = (char)arg.uVal;
+                    AppendPadded(output, piece, std::string_view(), std::string_view(), std::string_view(&ch, 1), false);
+                }
+                break;
+            case 's':
+                {
+                    std::string_view s = arg.sVal;
+                    if(piece.nPrecision >= 0 && (size_t)piece.nPrecision < s.length())
+                    {
+                        s = s.substr(0, piece.nPrecision);
+                    }
+                    AppendPadded(output, piece, std::string_view(), std::string_view(), s, false);
+                }
+                break;
+            case 'p':
+                {
+                    char chBuf[24];
+                    std::to_chars_result res = std::to_chars(chBuf, chBuf + sizeof(chBuf), (uintptr_t)arg.pVal, 16);
+                    AppendPadded(output, piece, std::string_view(), "0x", std::string_view(chBuf, res.ptr - chBuf), false);
+                }
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                AppendFloating(output, piece, arg.dVal);
+                break;
+            default:
+                AppendInteger(output, piece, arg);
+                break;
+            }
+        }
+
+        // Output须提供与std::string相同的append(string_view)、append(size_t, char)接口
+        template<class F, class Output, class... Args>
+        inline void FormatTo(Output& output, const Args&... args)
+        {
+            typedef CCompiledFormat<F> Compiled;
+            static_assert(Compiled::summary.error != FMT_BAD_CONVERSION, "Format: unsupported conversion specifier");
+            static_assert(Compiled::summary.error != FMT_STAR_UNSUPPORTED, "Format: '*' width/precision is not supported");
+            static_assert(Compiled::summary.error != FMT_DANGLING_PERCENT, "Format: format string ends with an incomplete '%'");
+            static_assert(Compiled::summary.nArgs == sizeof...(Args), "Format: argument count does not match the format string");
+            static_assert(FindMismatchedArg<F, Args...>() < 0, "Format: argument type does not match its conversion specifier");
+
+            const FormatArg argList[] = {FormatArg(), MakeFormatArg<typename std::decay<const Args>::type>(args)...};
+            for(size_t i = 0; i < Compiled::parse.nPieces; ++i)
+            {
+                const FormatPiece& piece = Compiled::parse.pieces[i];
+                if(0 == piece.chConv)
+                {
+                    output.append(Compiled::fmt.data() + piece.uBegin, piece.uLen);
+                }
+                else
+                {
+                    AppendFormatArg(output, piece, argList[piece.uArgIndex + 1]);
+                }
+            }
+        }
+
+        template<class F>
+        struct IsFormatLiteral : std::is_base_of<CFormatLiteralTag, F>
+        {
+        };
+    }
+
+    // 以下重载与const char*版本同名，仅接受STRFMT包装的格式串
+    template<class F, class... Args>
+    inline typename std::enable_if<detail::IsFormatLiteral<F>::value>::type
+        AppendString(std::string& output, F, const Args&... args)
+    {
+        detail::FormatTo<F>(output, args...);
+    }
+
+    template<class F, class... Args>
+    inline typename std::enable_if<detail::IsFormatLiteral<F>::value>::type
+        FormatString(std::string& output, F, const Args&... args)
+    {
+        output.erase();
+        detail::FormatTo<F>(output, args...);
+    }
+
+    template<class F, class... Args>
+    inline typename std::enable_if<detail::IsFormatLiteral<F>::value, std::string>::type
+        Format(F, const Args&... args)
+    {
+        std::string output;
+        detail::FormatTo<F>(output, args...);
+        return output;
+    }
+}
+
+// 包装格式串字面量，使其可在编译期解析
+#define STRFMT(s) ([] { \
+        struct CFormatLiteral : StringHelper::detail::CFormatLiteralTag \
+        { \
+            static constexpr std::string_view Get() { return s; } \
+        }; \
+        return CFormatLiteral(); \
+    }())
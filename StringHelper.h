@@ -5,11 +5,25 @@
 #include <vector>
 #include <stdarg.h>
 #include <sstream>
+#include <string_view>
+#include <iterator>
+#include <type_traits>
+#include "StringScan.h"
+#include "StringReplace.h"
+#include "StringFormat.h"
+#include "StringConvert.h"
+#include "StringCase.h"
+#include "StringCodec.h"
+#if defined(_MSC_VER)
 #if _MSC_VER < 1500
 #define vsnprintf(buf, length, format, ap) _vsnprintf(buf, length, format, ap)
 #else
 #define vsnprintf(buf, length, format, ap) _vsnprintf_s(buf, length, _TRUNCATE, format, ap)
 #endif
+#endif
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
 
 
 
@@ -22,27 +36,27 @@ namespace StringHelper
     static const char* spaces = " \t\n\v\f\r";    
     inline void TrimLeft(string &s)
     {
-        size_t pos = s.find_first_not_of(spaces);
+        size_t pos = FindFirstNotOf(s, clsSpaces);
         if(string::npos == pos)
         {
-            s = "";
+            s.clear();
         }
         else
         {
-            s = s.substr(pos);
+            s.erase(0, pos);
         }
     }
 
     inline void TrimRight(string &s)
     {
-        size_t pos = s.find_last_not_of(spaces);
+        size_t pos = FindLastNotOf(s, clsSpaces);
         if(string::npos == pos)
         {
-            s = "";
+            s.clear();
         }
         else
         {
-            s = s.substr(0, pos+1);
+            s.erase(pos+1);
         }
     }
 
@@ -54,49 +68,77 @@ namespace StringHelper
 
     inline std::string TrimLeft(const std::string& s, const string& trimTargets)
     {
-        std::string::size_type firstPos = s.find_first_not_of(trimTargets);	
+        std::string::size_type firstPos = FindFirstNotOf(s, trimTargets);	
         return (std::string::npos == firstPos) ? std::string() : s.substr(firstPos);
     }
 
     inline std::string TrimRight(const std::string& s, const string& trimTargets)
     {
-        std::string::size_type lastPos = s.find_last_not_of(trimTargets);		
+        std::string::size_type lastPos = FindLastNotOf(s, trimTargets);		
         return (std::string::npos == lastPos) ? std::string() : s.substr(0, lastPos+1);
     }
 
     inline std::string Trim(const std::string& s, const string& trimTargets)
     {
-        std::string str;
-        str = TrimLeft(s, trimTargets);
-        str = TrimRight(str, trimTargets);
-        return str;
+        CCharClass cls(trimTargets);
+        std::string::size_type firstPos = FindFirstNotOf(s, cls);
+        if(std::string::npos == firstPos)
+        {
+            return std::string();
+        }
+        std::string::size_type lastPos = FindLastNotOf(s, cls);
+        return s.substr(firstPos, lastPos-firstPos+1);
     }
 
+    // 只转换ASCII字母，GBK等多字节字符不受locale影响
     inline void Upper(string &s)
     {
-        for(size_t i=0; i<s.length(); i++)
-        {
-            s[i] = (char)toupper(s[i]);
-        }
+        AsciiUpper(s);
     }
 
     inline void Lower(string &s)
     {
-        for(size_t i=0; i<s.length(); i++)
-        {
-            s[i] = (char)tolower(s[i]);
-        }
+        AsciiLower(s);
     }
 
+    // 从左到右替换所有不重叠的src，src为空时不做任何替换
     inline void ReplaceAll(string &s, const string& src, const string &dst)
     {
-        int nPos = 0;
-        
-        while((nPos=s.find(src, nPos)) != -1)
+        if(src.empty())
         {
-            s.replace(nPos, src.length(), dst.c_str());
-            nPos += dst.length();
+            return;
+        }
+
+        string::size_type nPos = s.find(src);
+        if(string::npos == nPos)
+        {
+            return;
+        }
+
+        // 等长替换可原地覆盖
+        if(src.length() == dst.length())
+        {
+            do
+            {
+                s.replace(nPos, src.length(), dst);
+                nPos = s.find(src, nPos + src.length());
+            } while(string::npos != nPos);
+            return;
         }
+
+        // 不等长时一次性生成结果，避免每次replace都搬移尾部
+        string output;
+        output.reserve(s.length());
+        string::size_type nCopied = 0;
+        do
+        {
+            output.append(s, nCopied, nPos - nCopied);
+            output.append(dst);
+            nCopied = nPos + src.length();
+            nPos = s.find(src, nCopied);
+        } while(string::npos != nPos);
+        output.append(s, nCopied, string::npos);
+        s.swap(output);
     }
 
     inline bool EndsWith(const string &s, const string& suffix)
@@ -114,81 +156,281 @@ namespace StringHelper
         return pos == 0;
     }
 
-    //sep为空字符串时，取出连续空白符分隔的字符串
-    inline vector<string> Split(const string &s, const string &sep="", unsigned int nMaxSplit=-1)
+    //////////////////////////////////////////////////////////////////////////
+    // 惰性分词：按需产出string_view，不复制任何子串
+    // 语义与Split一致：
+    //   sep非空时按sep切分；sep为空时按连续空白符切分（开头的空白会产出一个空串）
+    //   nMaxSplit为最多产出的段数，达到后剩余部分直接丢弃
+    // 【注意】产出的string_view指向源字符串，源字符串须比分词结果活得久
+    //////////////////////////////////////////////////////////////////////////
+
+    /** @fn inline bool NextToken(string_view s, string_view sep, size_t& uPos, string_view& token)
+     *  @brief 从uPos处取出下一段，uPos更新为下一段的起始位置，取完最后一段后置为npos
+     *  @param (IN) string_view s 待切分字符串
+     *  @param (IN) string_view sep 分隔符，为空时按空白符切分
+     *  @param (IN/OUT) size_t& uPos 游标，初始为0
+     *  @param (OUT) string_view& token 取出的段
+     *  @return bool 游标已为npos时返回false
+     */
+    inline bool NextToken(string_view s, string_view sep, size_t& uPos, string_view& token)
     {
-        vector<string> vecStr;
+        if(string_view::npos == uPos)
+        {
+            return false;
+        }
 
-        if(!sep.empty())
+        size_t uEndPos = string_view::npos;
+        if(sep.empty())
+        {
+            uEndPos = FindFirstOf(s, clsSpaces, uPos);
+        }
+        else if(1 == sep.length())
+        {
+            uEndPos = FindChar(s, sep[0], uPos);
+        }
+        else
+        {
+            uEndPos = s.find(sep, uPos);
+        }
+        if(string_view::npos == uEndPos)
         {
-            string::size_type iBeginPos = 0;
-            string::size_type iEndPos = 0;
-            while((iEndPos=s.find(sep, iBeginPos)) != string::npos)
+            token = s.substr(uPos);
+            uPos = string_view::npos;
+            return true;
+        }
+
+        token = s.substr(uPos, uEndPos - uPos);
+        if(sep.empty())
+        {
+            // 末尾为空白时，再产出一个空串，与开头空白的处理对称
+            uPos = FindFirstNotOf(s, clsSpaces, uEndPos);
+            if(string_view::npos == uPos)
+            {
+                uPos = s.length();
+            }
+        }
+        else
+        {
+            uPos = uEndPos + sep.length();
+        }
+        return true;
+    }
+
+    class CSplitRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag   iterator_category;
+            typedef string_view                 value_type;
+            typedef ptrdiff_t                   difference_type;
+            typedef const string_view*          pointer;
+            typedef const string_view&          reference;
+
+            iterator()
+                : m_pRange(NULL)
+                , m_uPos(string_view::npos)
+                , m_nLeft(0)
+                , m_bEnd(true)
             {
-                if(vecStr.size() == nMaxSplit)
+            }
+
+            iterator(const CSplitRange* pRange)
+                : m_pRange(pRange)
+                , m_uPos(0)
+                , m_nLeft(pRange->m_nMaxSplit)
+                , m_bEnd(false)
+            {
+                Advance();
+            }
+
+            reference operator*() const
+            {
+                return m_token;
+            }
+
+            pointer operator->() const
+            {
+                return &m_token;
+            }
+
+            iterator& operator++()
+            {
+                Advance();
+                return *this;
+            }
+
+            iterator operator++(int)
+            {
+                iterator tmp(*this);
+                Advance();
+                return tmp;
+            }
+
+            bool operator==(const iterator& rhs) const
+            {
+                if(m_bEnd || rhs.m_bEnd)
                 {
-                    break;
+                    return m_bEnd == rhs.m_bEnd;
                 }
-                vecStr.push_back(s.substr(iBeginPos, iEndPos-iBeginPos));
-                iBeginPos = iEndPos + sep.length();
-                
+                return m_pRange == rhs.m_pRange && m_uPos == rhs.m_uPos;
+            }
+
+            bool operator!=(const iterator& rhs) const
+            {
+                return !(*this == rhs);
             }
-            if(vecStr.size() != nMaxSplit)
+
+        private:
+            void Advance()
             {
-                vecStr.push_back(s.substr(iBeginPos));
+                if(0 == m_nLeft || !NextToken(m_pRange->m_str, m_pRange->m_sep, m_uPos, m_token))
+                {
+                    m_bEnd = true;
+                    return;
+                }
+                --m_nLeft;
             }
-            
+
+        private:
+            const CSplitRange*  m_pRange;
+            size_t              m_uPos;
+            unsigned int        m_nLeft;
+            string_view         m_token;
+            bool                m_bEnd;
+        };
+        typedef iterator const_iterator;
+
+    public:
+        CSplitRange(string_view s, string_view sep = string_view(), unsigned int nMaxSplit = -1)
+            : m_str(s)
+            , m_sep(sep)
+            , m_nMaxSplit(nMaxSplit)
+        {
         }
-        else
+
+        iterator begin() const
         {
-            string::size_type iBeginPos = 0;
-            string::size_type iEndPos = 0;
+            return iterator(this);
+        }
+
+        iterator end() const
+        {
+            return iterator();
+        }
+
+    private:
+        string_view     m_str;
+        string_view     m_sep;
+        unsigned int    m_nMaxSplit;
+    };
+
+    /** @fn inline CSplitRange SplitView(string_view s, string_view sep = "", unsigned int nMaxSplit = -1)
+     *  @brief 返回惰性分词区间，可直接用于range-for
+     *    【注意】区间及其迭代器只保存源串的视图，源串须比它们活得久
+     */
+    inline CSplitRange SplitView(string_view s, string_view sep = string_view(), unsigned int nMaxSplit = -1)
+    {
+        return CSplitRange(s, sep, nMaxSplit);
+    }
 
-            while((iEndPos=s.find_first_of(spaces, iBeginPos)) != string::npos)
+    /** @fn inline size_t SplitEach(string_view s, string_view sep, Fn fn, unsigned int nMaxSplit = -1)
+     *  @brief 逐段回调，fn签名为void(string_view)或bool(string_view)，返回false时提前结束
+     *  @return size_t 回调的段数
+     */
+    template<class Fn>
+    inline size_t SplitEach(string_view s, string_view sep, Fn fn, unsigned int nMaxSplit = -1)
+    {
+        size_t uPos = 0;
+        size_t nCount = 0;
+        string_view token;
+        while(nCount != nMaxSplit && NextToken(s, sep, uPos, token))
+        {
+            ++nCount;
+            if constexpr (std::is_same<decltype(fn(token)), bool>::value)
             {
-                if(vecStr.size() == nMaxSplit)
+                if(!fn(token))
                 {
                     break;
                 }
-
-                vecStr.push_back(s.substr(iBeginPos, iEndPos-iBeginPos));
-                iBeginPos = s.find_first_not_of(spaces, iEndPos);
             }
-            if(vecStr.size() != nMaxSplit)
+            else
             {
-                vecStr.push_back(s.substr(iBeginPos));
+                fn(token);
             }
         }
-        
-        
+        return nCount;
+    }
+
+    /** @fn inline string_view TokenAt(string_view s, size_t nIndex, string_view sep = "")
+     *  @brief 取第nIndex段（从0开始），不足时返回空视图
+     */
+    inline string_view TokenAt(string_view s, size_t nIndex, string_view sep = string_view())
+    {
+        size_t uPos = 0;
+        string_view token;
+        while(NextToken(s, sep, uPos, token))
+        {
+            if(0 == nIndex--)
+            {
+                return token;
+            }
+        }
+        return string_view();
+    }
+
+    //sep为空字符串时，取出连续空白符分隔的字符串
+    inline vector<string> Split(const string &s, const string &sep="", unsigned int nMaxSplit=-1)
+    {
+        vector<string> vecStr;
+        SplitEach(s, sep, [&vecStr](string_view token)
+        {
+            vecStr.push_back(string(token));
+        }, nMaxSplit);
         return vecStr;
     }
 
+    // 新代码请使用STRFMT版本的Format/AppendString（见StringFormat.h），编译期检查且不经过vsnprintf
     inline void InternalStringPrintf(string& output, const char* format, va_list ap)
     {   
+        // ap每次使用都会被消耗，重试时须使用副本
+        va_list apCopy;
+        va_copy(apCopy, ap);
         char smallBuf[128];
-        int nCharsWritten = vsnprintf(smallBuf, sizeof(smallBuf), format, ap);
+        int nCharsWritten = vsnprintf(smallBuf, sizeof(smallBuf), format, apCopy);
+        va_end(apCopy);
         //if smallBuf is enough
-        if(nCharsWritten >= 0)
+        if(nCharsWritten >= 0 && nCharsWritten < (int)sizeof(smallBuf))
         {
             output.append(smallBuf, nCharsWritten);
             return;
         }
         
-        size_t length = sizeof(smallBuf);
+        // C99语义的vsnprintf返回所需长度，_vsnprintf_s截断时返回-1
+        size_t length = (nCharsWritten >= 0) ? (size_t)nCharsWritten + 1 : sizeof(smallBuf);
         while(true)
         {
-            length *= 2;
+            if(nCharsWritten < 0)
+            {
+                length *= 2;
+            }
             char *buf = new char[length];
 
-            nCharsWritten = vsnprintf(buf, length, format, ap);
-            if(nCharsWritten >= 0)
+            va_copy(apCopy, ap);
+            nCharsWritten = vsnprintf(buf, length, format, apCopy);
+            va_end(apCopy);
+            if(nCharsWritten >= 0 && (size_t)nCharsWritten < length)
             {
                 output.append(buf, nCharsWritten);
                 delete []buf;
                 return;
             }
             delete []buf;
+            if(nCharsWritten >= 0)
+            {
+                length = (size_t)nCharsWritten + 1;
+            }
         }
     }
     
@@ -221,7 +463,7 @@ namespace StringHelper
 
     inline string ToString(int i)
     {
-        return Format("%d", i);
+        return NumberToString(i);
     }
 
     inline string ToString(double d)
@@ -231,7 +473,7 @@ namespace StringHelper
         {
             d = 0; 
         }
-        return Format("%g", d);
+        return Format(STRFMT("%g"), d);
     }
 
 	inline void RemoveFrontZero(string& s)
@@ -255,9 +497,36 @@ namespace StringHelper
     template <class T>
     inline string T2String(const T& source)
     {
-        std::stringstream ss;
-        ss << source;
-        return ss.str();
+        // 整数与float/double走快速路径，浮点输出与ostream默认格式(%g)一致
+        if constexpr (detail::IsCharsConvertible<T>::value && std::is_integral<T>::value)
+        {
+            return NumberToString(source);
+        }
+        else if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value)
+        {
+            return Format(STRFMT("%g"), source);
+        }
+        else
+        {
+            std::stringstream ss;
+            ss << source;
+            return ss.str();
+        }
+    }
+
+    namespace detail
+    {
+        // 快速路径只处理以数字或小数点开头的文本，inf/nan、无符号数的负值等交给stringstream，以保持原有语义
+        inline bool IsPlainNumber(string_view s)
+        {
+            const char* p = SkipSpaces(s.data(), s.data() + s.length());
+            const char* pEnd = s.data() + s.length();
+            if(p != pEnd && (*p == '+' || *p == '-'))
+            {
+                ++p;
+            }
+            return p != pEnd && ((*p >= '0' && *p <= '9') || *p == '.');
+        }
     }
 
     /** @fn inline T String2T(const string& str)
@@ -277,7 +546,17 @@ namespace StringHelper
             return value;
         }
         
-        T value;
+        T value = T();
+        if constexpr (detail::IsCharsConvertible<T>::value)
+        {
+            size_t uConsumed = 0;
+            if(detail::IsPlainNumber(str)
+                && (std::is_signed<T>::value || str[str.find_first_not_of(spaces)] != '-')
+                && ParseNumberPrefix(str, value, uConsumed) == std::errc())
+            {
+                return value;
+            }
+        }
         std::stringstream ss(str);
         ss >> value;
         return value;
@@ -287,9 +566,16 @@ namespace StringHelper
 	template <typename T>
 	inline const T lexical_cast(const std::string& s, const T defaultVal)
 	{
-		std::stringstream ss(s);
-	
 		T result;
+		if constexpr (detail::IsCharsConvertible<T>::value)
+		{
+			if (detail::IsPlainNumber(s) && ParseNumber(s, result) == std::errc())
+			{
+				return result;
+			}
+		}
+
+		std::stringstream ss(s);
 		if ((ss >> result).fail() || !(ss >> std::ws).eof())
 		{
 			return defaultVal;
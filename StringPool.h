@@ -0,0 +1,411 @@
+/********************************************************************
+	filename: 	StringPool.h
+
+	purpose:	字符串驻留池，相同内容的字符串只保存一份
+	            CInternedString为指向池中条目的句柄：相等比较即指针比较，哈希值预先算好
+	            池中条目在池的生命周期内不会释放或移动，全局池永不析构
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include "LockHelper.h"
+#ifndef _WIN32
+#include "FutexLock.h"
+#endif
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // 8字节一组的乘法哈希，用于驻留池
+        inline uint64_t HashBytes(std::string_view s)
+        {
+            const uint64_t uMul = 0x9E3779B97F4A7C15ULL;
+            uint64_t h = (s.length() + 1) * uMul;
+            size_t i = 0;
+            for(; i + 8 <= s.length(); i += 8)
+            {
+                uint64_t w;
+                memcpy(&w, s.data() + i, sizeof(w));
+                h = (h ^ w) * uMul;
+                h ^= h >> 29;
+            }
+            if(i < s.length())
+            {
+                uint64_t w = 0;
+                memcpy(&w, s.data() + i, s.length() - i);
+                h = (h ^ w) * uMul;
+                h ^= h >> 29;
+            }
+            h ^= h >> 32;
+            return h;
+        }
+
+        struct InternEntry
+        {
+            uint64_t    uHash;
+            size_t      uLen;
+            char        chData[1];  // 以'\0'结尾
+        };
+
+        inline const InternEntry* EmptyInternEntry()
+        {
+            static const InternEntry entry = {HashBytes(std::string_view()), 0, {0}};
+            return &entry;
+        }
+    }
+
+    class CStringPool;
+
+    // 驻留字符串句柄，可自由拷贝，默认构造为空串
+    class CInternedString
+    {
+    public:
+        CInternedString()
+            : m_pEntry(detail::EmptyInternEntry())
+        {
+        }
+
+    public:
+        std::string_view View() const
+        {
+            return std::string_view(m_pEntry->chData, m_pEntry->uLen);
+        }
+
+        const char* c_str() const
+        {
+            return m_pEntry->chData;
+        }
+
+        size_t length() const
+        {
+            return m_pEntry->uLen;
+        }
+
+        bool empty() const
+        {
+            return 0 == m_pEntry->uLen;
+        }
+
+        std::string ToString() const
+        {
+            return std::string(m_pEntry->chData, m_pEntry->uLen);
+        }
+
+        uint64_t Hash() const
+        {
+            return m_pEntry->uHash;
+        }
+
+        operator std::string_view() const
+        {
+            return View();
+        }
+
+        // 同一个池中的句柄，内容相同当且仅当指针相同
+        bool operator==(const CInternedString& rhs) const
+        {
+            return m_pEntry == rhs.m_pEntry;
+        }
+
+        bool operator!=(const CInternedString& rhs) const
+        {
+            return m_pEntry != rhs.m_pEntry;
+        }
+
+        // 按地址排序，只用于有序容器的键，不是字典序
+        bool operator<(const CInternedString& rhs) const
+        {
+            return std::less<const detail::InternEntry*>()(m_pEntry, rhs.m_pEntry);
+        }
+
+    private:
+        friend class CStringPool;
+        explicit CInternedString(const detail::InternEntry* pEntry)
+            : m_pEntry(pEntry)
+        {
+        }
+
+    private:
+        const detail::InternEntry* m_pEntry;
+    };
+
+    //////////////////////////////////////////////////////////////////////////
+    // 线程安全的驻留池：按哈希分片，每片一张开放寻址表
+    // 查找已存在的字符串不加锁（表与条目只增不改，发布时带release语义），
+    // 未命中时才在分片锁内插入。扩容后的旧表延迟到池析构时释放
+    //////////////////////////////////////////////////////////////////////////
+    class CStringPool
+    {
+    public:
+        CStringPool()
+        {
+        }
+
+        ~CStringPool()
+        {
+            for(size_t i = 0; i < SHARD_COUNT; ++i)
+            {
+                Shard& shard = m_shards[i];
+                for(size_t k = 0; k < shard.vecRetired.size(); ++k)
+                {
+                    FreeTable(shard.vecRetired[k]);
+                }
+                FreeTable(shard.pTable.load(std::memory_order_relaxed));
+                for(size_t k = 0; k < shard.vecBlocks.size(); ++k)
+                {
+                    delete [] shard.vecBlocks[k];
+                }
+            }
+        }
+
+    private: // 拒绝拷贝
+        CStringPool(const CStringPool&);
+        CStringPool& operator=(const CStringPool&);
+
+    public:
+        // 进程级全局池，永不析构，其句柄在进程退出前始终有效
+        static CStringPool& Global()
+        {
+            static CStringPool* s_pPool = new CStringPool;
+            return *s_pPool;
+        }
+
+        CInternedString Intern(std::string_view s)
+        {
+            if(s.empty())
+            {
+                return CInternedString();
+            }
+
+            uint64_t uHash = detail::HashBytes(s);
+            Shard& shard = m_shards[uHash >> (64 - SHARD_BITS)];
+            const detail::InternEntry* pEntry = Lookup(shard.pTable.load(std::memory_order_acquire), s, uHash);
+            if(pEntry)
+            {
+                return CInternedString(pEntry);
+            }
+
+            SCOPED_SAFELOCK(&shard.lock);
+            Table* pTable = shard.pTable.load(std::memory_order_relaxed);
+            pEntry = Lookup(pTable, s, uHash);
+            if(pEntry)
+            {
+                return CInternedString(pEntry);
+            }
+
+            if(NULL == pTable || (shard.uCount + 1) * 2 > pTable->uMask + 1)
+            {
+                pTable = Grow(shard);
+            }
+            pEntry = NewEntry(shard, s, uHash);
+            size_t uIdx = (size_t)uHash & pTable->uMask;
+            while(pTable->slots[uIdx].load(std::memory_order_relaxed))
+            {
+                uIdx = (uIdx + 1) & pTable->uMask;
+            }
+            pTable->slots[uIdx].store(pEntry, std::memory_order_release);
+            ++shard.uCount;
+            return CInternedString(pEntry);
+        }
+
+        // 只查找不插入，未驻留时返回false
+        bool Find(std::string_view s, CInternedString& result) const
+        {
+            if(s.empty())
+            {
+                result = CInternedString();
+                return true;
+            }
+
+            uint64_t uHash = detail::HashBytes(s);
+            const Shard& shard = m_shards[uHash >> (64 - SHARD_BITS)];
+            const detail::InternEntry* pEntry = Lookup(shard.pTable.load(std::memory_order_acquire), s, uHash);
+            if(pEntry)
+            {
+                result = CInternedString(pEntry);
+                return true;
+            }
+            return false;
+        }
+
+        // 驻留的字符串个数（不含空串）
+        size_t Size() const
+        {
+            size_t uSize = 0;
+            for(size_t i = 0; i < SHARD_COUNT; ++i)
+            {
+                SCOPED_SAFELOCK(&m_shards[i].lock);
+                uSize += m_shards[i].uCount;
+            }
+            return uSize;
+        }
+
+    private:
+        enum
+        {
+            SHARD_BITS      = 4,
+            SHARD_COUNT     = 1 << SHARD_BITS,
+            INIT_SLOTS      = 64,
+            BLOCK_SIZE      = 64 * 1024,
+        };
+
+        struct Table
+        {
+            size_t                                          uMask;
+            std::atomic<const detail::InternEntry*>         slots[1];
+        };
+
+        // Windows下仍用临界区：BlockArchive.h包含本文件，换成CFutexLock会让序列化器的所有使用者都依赖Win8的WaitOnAddress
+#ifdef _WIN32
+        typedef CCriticalSectionLock    ShardLock;
+#else
+        typedef CFutexLock              ShardLock;
+#endif
+
+        struct alignas(64) Shard
+        {
+            Shard()
+                : pTable(NULL)
+                , uCount(0)
+                , pBlockCur(NULL)
+                , uBlockLeft(0)
+            {
+            }
+
+            mutable ShardLock               lock;           /*只在插入时持有，临界区很短*/
+            std::atomic<Table*>             pTable;
+            size_t                          uCount;
+            std::vector<Table*>             vecRetired;     /*扩容换下的旧表，可能仍有读者在用*/
+            std::vector<char*>              vecBlocks;      /*条目所在的内存块*/
+            char*                           pBlockCur;
+            size_t                          uBlockLeft;
+        };
+
+        static const detail::InternEntry* Lookup(const Table* pTable, std::string_view s, uint64_t uHash)
+        {
+            if(NULL == pTable)
+            {
+                return NULL;
+            }
+            size_t uIdx = (size_t)uHash & pTable->uMask;
+            while(true)
+            {
+                const detail::InternEntry* pEntry = pTable->slots[uIdx].load(std::memory_order_acquire);
+                if(NULL == pEntry)
+                {
+                    return NULL;
+                }
+                if(pEntry->uHash == uHash && pEntry->uLen == s.length() && 0 == memcmp(pEntry->chData, s.data(), s.length()))
+                {
+                    return pEntry;
+                }
+                uIdx = (uIdx + 1) & pTable->uMask;
+            }
+        }
+
+        static Table* AllocTable(size_t uSlots)
+        {
+            char* pMem = new char[offsetof(Table, slots) + uSlots * sizeof(std::atomic<const detail::InternEntry*>)];
+            Table* pTable = reinterpret_cast<Table*>(pMem);
+            pTable->uMask = uSlots - 1;
+            for(size_t i = 0; i < uSlots; ++i)
+            {
+                new (&pTable->slots[i]) std::atomic<const detail::InternEntry*>(NULL);
+            }
+            return pTable;
+        }
+
+        static void FreeTable(Table* pTable)
+        {
+            delete [] reinterpret_cast<char*>(pTable);
+        }
+
+        // 在分片锁内调用
+        static Table* Grow(Shard& shard)
+        {
+            Table* pOld = shard.pTable.load(std::memory_order_relaxed);
+            size_t uSlots = pOld ? (pOld->uMask + 1) * 2 : (size_t)INIT_SLOTS;
+            Table* pNew = AllocTable(uSlots);
+            if(pOld)
+            {
+                for(size_t i = 0; i <= pOld->uMask; ++i)
+                {
+                    const detail::InternEntry* pEntry = pOld->slots[i].load(std::memory_order_relaxed);
+                    if(pEntry)
+                    {
+                        size_t uIdx = (size_t)pEntry->uHash & pNew->uMask;
+                        while(pNew->slots[uIdx].load(std::memory_order_relaxed))
+                        {
+                            uIdx = (uIdx + 1) & pNew->uMask;
+                        }
+                        pNew->slots[uIdx].store(pEntry, std::memory_order_relaxed);
+                    }
+                }
+                shard.vecRetired.push_back(pOld);
+            }
+            shard.pTable.store(pNew, std::memory_order_release);
+            return pNew;
+        }
+
+        // 在分片锁内调用，条目从分片的内存块中顺序分配
+        static const detail::InternEntry* NewEntry(Shard& shard, std::string_view s, uint64_t uHash)
+        {
+            size_t uSize = offsetof(detail::InternEntry, chData) + s.length() + 1;
+            uSize = (uSize + alignof(detail::InternEntry) - 1) & ~(alignof(detail::InternEntry) - 1);
+            char* pMem = NULL;
+            if(uSize > BLOCK_SIZE / 4)
+            {
+                pMem = new char[uSize];
+                shard.vecBlocks.push_back(pMem);
+            }
+            else
+            {
+                if(uSize > shard.uBlockLeft)
+                {
+                    shard.pBlockCur = new char[BLOCK_SIZE];
+                    shard.uBlockLeft = BLOCK_SIZE;
+                    shard.vecBlocks.push_back(shard.pBlockCur);
+                }
+                pMem = shard.pBlockCur;
+                shard.pBlockCur += uSize;
+                shard.uBlockLeft -= uSize;
+            }
+
+            detail::InternEntry* pEntry = reinterpret_cast<detail::InternEntry*>(pMem);
+            pEntry->uHash = uHash;
+            pEntry->uLen = s.length();
+            memcpy(pEntry->chData, s.data(), s.length());
+            pEntry->chData[s.length()] = '\0';
+            return pEntry;
+        }
+
+    private:
+        Shard   m_shards[SHARD_COUNT];
+    };
+
+    // 在全局池中驻留
+    inline CInternedString Intern(std::string_view s)
+    {
+        return CStringPool::Global().Intern(s);
+    }
+}
+
+namespace std
+{
+    template<>
+    struct hash<StringHelper::CInternedString>
+    {
+        size_t operator()(const StringHelper::CInternedString& s) const
+        {
+            return (size_t)s.Hash();
+        }
+    };
+}
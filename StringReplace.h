@@ -0,0 +1,222 @@
+/********************************************************************
+	filename: 	StringReplace.h
+
+	purpose:	多模式替换，基于Aho-Corasick自动机一次扫描完成多组替换
+*********************************************************************/
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <deque>
+#include <stdint.h>
+#include <string.h>
+
+namespace StringHelper
+{
+    //////////////////////////////////////////////////////////////////////////
+    // 多模式替换器，构造时编译规则，之后可在多个线程中并发使用
+    // 匹配规则：
+    //   1、所有规则在原文上一次扫描完成，替换出的文本不会被再次匹配，
+    //      这一点与依次调用多次ReplaceAll不同
+    //   2、匹配位置重叠时靠左者优先，同一起点取最长的模式
+    //   3、模式重复时以先出现的规则为准，空模式被忽略
+    //////////////////////////////////////////////////////////////////////////
+    class CMultiReplacer
+    {
+    public:
+        typedef std::pair<std::string, std::string> Rule;
+
+        explicit CMultiReplacer(const std::vector<Rule>& rules)
+            : m_vecRules(rules)
+            , m_nClasses(1)
+            , m_uMaxLen(0)
+        {
+            Build();
+        }
+
+    public:
+        // 将替换结果追加到output
+        void Apply(std::string_view input, std::string& output) const
+        {
+            if(0 == m_uMaxLen)
+            {
+                output.append(input.data(), input.length());
+                return;
+            }
+
+            output.reserve(output.length() + input.length());
+
+            // 以起点对maxLen取模的环形表，记录从该起点开始的最长匹配
+            std::vector<int32_t> vecBest(m_uMaxLen, -1);
+            size_t uCopied = 0;
+            int32_t nState = 0;
+            for(size_t i = 0; i < input.length(); ++i)
+            {
+                nState = m_vecNext[nState * m_nClasses + m_classOf[(unsigned char)input[i]]];
+                int32_t nNode = (m_vecOutput[nState] >= 0) ? nState : m_vecDictLink[nState];
+                for(; nNode >= 0; nNode = m_vecDictLink[nNode])
+                {
+                    int32_t nRule = m_vecOutput[nNode];
+                    size_t uLen = m_vecRules[nRule].first.length();
+                    int32_t& nBest = vecBest[(i + 1 - uLen) % m_uMaxLen];
+                    if(nBest < 0 || m_vecRules[nBest].first.length() < uLen)
+                    {
+                        nBest = nRule;
+                    }
+                }
+
+                // 起点为i+1-maxLen的匹配此后不会再出现，可以落定
+                if(i + 1 >= m_uMaxLen)
+                {
+                    Settle(input, i + 1 - m_uMaxLen, vecBest, uCopied, output);
+                }
+            }
+
+            size_t uStart = (input.length() >= m_uMaxLen) ? input.length() - m_uMaxLen + 1 : 0;
+            for(; uStart < input.length(); ++uStart)
+            {
+                Settle(input, uStart, vecBest, uCopied, output);
+            }
+            output.append(input.data() + uCopied, input.length() - uCopied);
+        }
+
+        std::string Apply(std::string_view input) const
+        {
+            std::string output;
+            Apply(input, output);
+            return output;
+        }
+
+        // 原地替换
+        void Apply(std::string& s) const
+        {
+            std::string output;
+            Apply(s, output);
+            s.swap(output);
+        }
+
+    private:
+        void Settle(std::string_view input, size_t uStart, std::vector<int32_t>& vecBest, size_t& uCopied, std::string& output) const
+        {
+            int32_t& nBest = vecBest[uStart % m_uMaxLen];
+            if(nBest >= 0 && uStart >= uCopied)
+            {
+                const Rule& rule = m_vecRules[nBest];
+                output.append(input.data() + uCopied, uStart - uCopied);
+                output.append(rule.second);
+                uCopied = uStart + rule.first.length();
+            }
+            nBest = -1;
+        }
+
+        void Build()
+        {
+            // 字母表压缩：模式中未出现的字节同属0类，转移表的宽度只与模式用到的字节数有关
+            memset(m_classOf, 0, sizeof(m_classOf));
+            for(size_t i = 0; i < m_vecRules.size(); ++i)
+            {
+                const std::string& sPattern = m_vecRules[i].first;
+                for(size_t k = 0; k < sPattern.length(); ++k)
+                {
+                    unsigned char c = (unsigned char)sPattern[k];
+                    if(0 == m_classOf[c])
+                    {
+                        m_classOf[c] = (uint16_t)m_nClasses++;
+                    }
+                }
+            }
+
+            // 建trie，-1表示无转移
+            std::vector<int32_t> vecTrie(m_nClasses, -1);
+            m_vecOutput.assign(1, -1);
+            for(size_t i = 0; i < m_vecRules.size(); ++i)
+            {
+                const std::string& sPattern = m_vecRules[i].first;
+                if(sPattern.empty())
+                {
+                    continue;
+                }
+
+                int32_t nNode = 0;
+                for(size_t k = 0; k < sPattern.length(); ++k)
+                {
+                    size_t uIdx = nNode * m_nClasses + m_classOf[(unsigned char)sPattern[k]];
+                    if(vecTrie[uIdx] < 0)
+                    {
+                        vecTrie[uIdx] = (int32_t)m_vecOutput.size();
+                        m_vecOutput.push_back(-1);
+                        vecTrie.resize(vecTrie.size() + m_nClasses, -1);
+                    }
+                    nNode = vecTrie[uIdx];
+                }
+                if(m_vecOutput[nNode] < 0)
+                {
+                    m_vecOutput[nNode] = (int32_t)i;
+                }
+                if(sPattern.length() > m_uMaxLen)
+                {
+                    m_uMaxLen = sPattern.length();
+                }
+            }
+
+            // BFS计算失败链接，补全为DFA转移表，并生成输出链接
+            const size_t nNodes = m_vecOutput.size();
+            m_vecNext.swap(vecTrie);
+            m_vecDictLink.assign(nNodes, -1);
+            std::vector<int32_t> vecFail(nNodes, 0);
+            std::deque<int32_t> queNodes;
+            for(size_t c = 0; c < m_nClasses; ++c)
+            {
+                int32_t& nChild = m_vecNext[c];
+                if(nChild < 0)
+                {
+                    nChild = 0;
+                }
+                else
+                {
+                    queNodes.push_back(nChild);
+                }
+            }
+            while(!queNodes.empty())
+            {
+                int32_t nNode = queNodes.front();
+                queNodes.pop_front();
+
+                int32_t nFail = vecFail[nNode];
+                m_vecDictLink[nNode] = (m_vecOutput[nFail] >= 0) ? nFail : m_vecDictLink[nFail];
+                for(size_t c = 0; c < m_nClasses; ++c)
+                {
+                    int32_t& nChild = m_vecNext[nNode * m_nClasses + c];
+                    if(nChild < 0)
+                    {
+                        nChild = m_vecNext[nFail * m_nClasses + c];
+                    }
+                    else
+                    {
+                        vecFail[nChild] = m_vecNext[nFail * m_nClasses + c];
+                        queNodes.push_back(nChild);
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<Rule>       m_vecRules;
+        uint16_t                m_classOf[256];     /*字节到字符类的映射*/
+        size_t                  m_nClasses;
+        size_t                  m_uMaxLen;          /*最长模式长度*/
+        std::vector<int32_t>    m_vecNext;          /*DFA转移表，nNode * m_nClasses + 类*/
+        std::vector<int32_t>    m_vecOutput;        /*节点本身对应的规则，-1表示非终止节点*/
+        std::vector<int32_t>    m_vecDictLink;      /*沿失败链接的下一个终止节点*/
+    };
+
+    /** @fn inline void ReplaceMany(std::string& s, const std::vector<CMultiReplacer::Rule>& rules)
+     *  @brief 一次扫描完成多组替换，匹配规则见CMultiReplacer
+     *    同一组规则反复使用时，应直接保存CMultiReplacer以免重复编译
+     */
+    inline void ReplaceMany(std::string& s, const std::vector<CMultiReplacer::Rule>& rules)
+    {
+        CMultiReplacer(rules).Apply(s);
+    }
+}
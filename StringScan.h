@@ -0,0 +1,434 @@
+/********************************************************************
+	filename: 	StringScan.h
+
+	purpose:	字符集扫描，StringHelper中find_first_of类查找的向量化实现
+	            AVX2(需/arch:AVX2或-mavx2) > SSE2 > 标量，按编译选项择优，
+	            SSSE3(需/arch:AVX或-mssse3)供需要pshufb的编解码使用，
+	            定义STRINGHELPER_NO_SIMD可强制使用标量实现
+*********************************************************************/
+#pragma once
+#include <string.h>
+#include <string_view>
+#include <stdint.h>
+
+#ifndef STRINGHELPER_NO_SIMD
+#if defined(__AVX2__)
+#define STRINGHELPER_AVX2 1
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#define STRINGHELPER_SSSE3 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRINGHELPER_SSE2 1
+#endif
+#endif
+
+#if defined(STRINGHELPER_AVX2)
+#include <immintrin.h>
+#elif defined(STRINGHELPER_SSSE3)
+#include <tmmintrin.h>
+#elif defined(STRINGHELPER_SSE2)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace StringHelper
+{
+    namespace detail
+    {
+        // 最低位1的下标，x不能为0
+        inline unsigned int LowestBit(uint32_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long idx = 0;
+            _BitScanForward(&idx, x);
+            return idx;
+#else
+            return __builtin_ctz(x);
+#endif
+        }
+
+        // 最高位1的下标，x不能为0
+        inline unsigned int HighestBit(uint32_t x)
+        {
+#ifdef _MSC_VER
+            unsigned long idx = 0;
+            _BitScanReverse(&idx, x);
+            return idx;
+#else
+            return 31 - __builtin_clz(x);
+#endif
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 字符集合：256位位图用于标量判断；集合不超过16个字符时同时保存字符表，
+    // 供SIMD逐字符广播比较。构造代价不可忽略，频繁使用的集合应预先构造
+    //////////////////////////////////////////////////////////////////////////
+    class CCharClass
+    {
+    public:
+        enum { MAX_SIMD_CHARS = 16 };
+
+        explicit constexpr CCharClass(std::string_view chars)
+        {
+            for(size_t i = 0; i < chars.length(); ++i)
+            {
+                unsigned char c = (unsigned char)chars[i];
+                if(Test(c))
+                {
+                    continue;
+                }
+                m_bitmap[c >> 5] |= (uint32_t)1 << (c & 31);
+                if(m_nChars < MAX_SIMD_CHARS)
+                {
+                    m_chars[m_nChars] = c;
+                }
+                ++m_nChars;
+            }
+        }
+
+        constexpr bool Test(unsigned char c) const
+        {
+            return ((m_bitmap[c >> 5] >> (c & 31)) & 1) != 0;
+        }
+
+        // 去重后的字符数
+        constexpr size_t Count() const
+        {
+            return m_nChars;
+        }
+
+        constexpr bool IsSimdUsable() const
+        {
+            return m_nChars > 0 && m_nChars <= MAX_SIMD_CHARS;
+        }
+
+        constexpr const unsigned char* Chars() const
+        {
+            return m_chars;
+        }
+
+    private:
+        uint32_t        m_bitmap[8] = {};
+        unsigned char   m_chars[MAX_SIMD_CHARS] = {};
+        size_t          m_nChars = 0;
+    };
+
+    // 空白字符集合，与StringHelper::spaces一致
+    static constexpr CCharClass clsSpaces(" \t\n\v\f\r");
+
+    namespace detail
+    {
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        // 16字节块中属于集合的位掩码
+        inline uint32_t MatchMask16(__m128i block, const __m128i* pSets, size_t nSets)
+        {
+            __m128i hit = _mm_cmpeq_epi8(block, pSets[0]);
+            for(size_t i = 1; i < nSets; ++i)
+            {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(block, pSets[i]));
+            }
+            return (uint32_t)_mm_movemask_epi8(hit);
+        }
+#endif
+
+#if defined(STRINGHELPER_AVX2)
+        inline uint32_t MatchMask32(__m256i block, const __m256i* pSets, size_t nSets)
+        {
+            __m256i hit = _mm256_cmpeq_epi8(block, pSets[0]);
+            for(size_t i = 1; i < nSets; ++i)
+            {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, pSets[i]));
+            }
+            return (uint32_t)_mm256_movemask_epi8(hit);
+        }
+#endif
+
+        /** @fn inline size_t ScanForward(const char* p, size_t n, const CCharClass& cls, bool bMatch)
+         *  @brief 正向查找第一个“属于集合 == bMatch”的字符
+         *  @return size_t 下标，未找到返回npos
+         */
+        inline size_t ScanForward(const char* p, size_t n, const CCharClass& cls, bool bMatch)
+        {
+            size_t i = 0;
+            if(bMatch && 1 == cls.Count())
+            {
+                const void* pHit = memchr(p, cls.Chars()[0], n);
+                return pHit ? (const char*)pHit - p : std::string_view::npos;
+            }
+
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            if(cls.IsSimdUsable())
+            {
+                const size_t nSets = cls.Count();
+                const uint32_t uFlip = bMatch ? 0 : 0xFFFFFFFF;
+#if defined(STRINGHELPER_AVX2)
+                __m256i sets32[CCharClass::MAX_SIMD_CHARS];
+                for(size_t k = 0; k < nSets; ++k)
+                {
+                    sets32[k] = _mm256_set1_epi8((char)cls.Chars()[k]);
+                }
+                for(; i + 32 <= n; i += 32)
+                {
+                    __m256i block = _mm256_loadu_si256((const __m256i*)(p + i));
+                    uint32_t uMask = MatchMask32(block, sets32, nSets) ^ uFlip;
+                    if(uMask)
+                    {
+                        return i + LowestBit(uMask);
+                    }
+                }
+#endif
+                __m128i sets16[CCharClass::MAX_SIMD_CHARS];
+                for(size_t k = 0; k < nSets; ++k)
+                {
+                    sets16[k] = _mm_set1_epi8((char)cls.Chars()[k]);
+                }
+                for(; i + 16 <= n; i += 16)
+                {
+                    __m128i block = _mm_loadu_si128((const __m128i*)(p + i));
+                    uint32_t uMask = (MatchMask16(block, sets16, nSets) ^ uFlip) & 0xFFFF;
+                    if(uMask)
+                    {
+                        return i + LowestBit(uMask);
+                    }
+                }
+            }
+#endif
+            for(; i < n; ++i)
+            {
+                if(cls.Test((unsigned char)p[i]) == bMatch)
+                {
+                    return i;
+                }
+            }
+            return std::string_view::npos;
+        }
+
+        /** @fn inline size_t ScanBackward(const char* p, size_t n, const CCharClass& cls, bool bMatch)
+         *  @brief 在[0, n)中反向查找最后一个“属于集合 == bMatch”的字符
+         *  @return size_t 下标，未找到返回npos
+         */
+        inline size_t ScanBackward(const char* p, size_t n, const CCharClass& cls, bool bMatch)
+        {
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+            if(cls.IsSimdUsable())
+            {
+                const size_t nSets = cls.Count();
+                const uint32_t uFlip = bMatch ? 0 : 0xFFFFFFFF;
+#if defined(STRINGHELPER_AVX2)
+                __m256i sets32[CCharClass::MAX_SIMD_CHARS];
+                for(size_t k = 0; k < nSets; ++k)
+                {
+                    sets32[k] = _mm256_set1_epi8((char)cls.Chars()[k]);
+                }
+                for(; n >= 32; n -= 32)
+                {
+                    __m256i block = _mm256_loadu_si256((const __m256i*)(p + n - 32));
+                    uint32_t uMask = MatchMask32(block, sets32, nSets) ^ uFlip;
+                    if(uMask)
+                    {
+                        return n - 32 + HighestBit(uMask);
+                    }
+                }
+#endif
+                __m128i sets16[CCharClass::MAX_SIMD_CHARS];
+                for(size_t k = 0; k < nSets; ++k)
+                {
+                    sets16[k] = _mm_set1_epi8((char)cls.Chars()[k]);
+                }
+                for(; n >= 16; n -= 16)
+                {
+                    __m128i block = _mm_loadu_si128((const __m128i*)(p + n - 16));
+                    uint32_t uMask = (MatchMask16(block, sets16, nSets) ^ uFlip) & 0xFFFF;
+                    if(uMask)
+                    {
+                        return n - 16 + HighestBit(uMask);
+                    }
+                }
+            }
+#endif
+            while(n > 0)
+            {
+                --n;
+                if(cls.Test((unsigned char)p[n]) == bMatch)
+                {
+                    return n;
+                }
+            }
+            return std::string_view::npos;
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 与std::string::find_first_of等同语义的查找函数，pos越界时返回npos
+    //////////////////////////////////////////////////////////////////////////
+    inline size_t FindFirstOf(std::string_view s, const CCharClass& cls, size_t pos = 0)
+    {
+        if(pos >= s.length())
+        {
+            return std::string_view::npos;
+        }
+        size_t idx = detail::ScanForward(s.data() + pos, s.length() - pos, cls, true);
+        return std::string_view::npos == idx ? idx : pos + idx;
+    }
+
+    inline size_t FindFirstNotOf(std::string_view s, const CCharClass& cls, size_t pos = 0)
+    {
+        if(pos >= s.length())
+        {
+            return std::string_view::npos;
+        }
+        size_t idx = detail::ScanForward(s.data() + pos, s.length() - pos, cls, false);
+        return std::string_view::npos == idx ? idx : pos + idx;
+    }
+
+    // pos为最后一个参与查找的下标，缺省查找整个字符串
+    inline size_t FindLastOf(std::string_view s, const CCharClass& cls, size_t pos = std::string_view::npos)
+    {
+        size_t n = (pos < s.length()) ? pos + 1 : s.length();
+        return detail::ScanBackward(s.data(), n, cls, true);
+    }
+
+    inline size_t FindLastNotOf(std::string_view s, const CCharClass& cls, size_t pos = std::string_view::npos)
+    {
+        size_t n = (pos < s.length()) ? pos + 1 : s.length();
+        return detail::ScanBackward(s.data(), n, cls, false);
+    }
+
+    // 单字符查找，走memchr
+    inline size_t FindChar(std::string_view s, char c, size_t pos = 0)
+    {
+        if(pos >= s.length())
+        {
+            return std::string_view::npos;
+        }
+        const void* pHit = memchr(s.data() + pos, c, s.length() - pos);
+        return pHit ? (const char*)pHit - s.data() : std::string_view::npos;
+    }
+
+    namespace detail
+    {
+        // 32字节块中等于c的位掩码，n不足32时只看前n字节
+        inline uint32_t CharMask32(const char* p, size_t n, char c)
+        {
+#if defined(STRINGHELPER_AVX2)
+            if(n >= 32)
+            {
+                return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi8(c)));
+            }
+#elif defined(STRINGHELPER_SSE2)
+            if(n >= 32)
+            {
+                __m128i vc = _mm_set1_epi8(c);
+                uint32_t uLo = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), vc));
+                uint32_t uHi = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 16)), vc));
+                return uLo | (uHi << 16);
+            }
+#endif
+            uint32_t uMask = 0;
+            for(size_t i = 0; i < n && i < 32; ++i)
+            {
+                uMask |= (uint32_t)(p[i] == c) << i;
+            }
+            return uMask;
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // 依次取出某字符的所有位置：每32字节做一次SIMD比较得到位掩码，再逐位取出
+    // 分隔符很密时（如短行）比逐个调用memchr省去大量调用开销
+    //////////////////////////////////////////////////////////////////////////
+    class CCharCursor
+    {
+    public:
+        CCharCursor(std::string_view s, char c)
+            : m_s(s)
+            , m_ch(c)
+            , m_uBlock(0)
+            , m_uScanned(0)
+            , m_uMask(0)
+        {
+        }
+
+        // 返回下一个该字符的下标，没有更多时返回npos
+        size_t Next()
+        {
+            while(0 == m_uMask)
+            {
+                if(m_uScanned >= m_s.length())
+                {
+                    return std::string_view::npos;
+                }
+                m_uBlock = m_uScanned;
+                m_uMask = detail::CharMask32(m_s.data() + m_uBlock, m_s.length() - m_uBlock, m_ch);
+                m_uScanned += 32;
+            }
+            size_t uPos = m_uBlock + detail::LowestBit(m_uMask);
+            m_uMask &= m_uMask - 1;
+            return uPos;
+        }
+
+    private:
+        std::string_view    m_s;
+        char                m_ch;
+        size_t              m_uBlock;       /*当前掩码对应块的起始下标*/
+        size_t              m_uScanned;     /*已比较到的位置*/
+        uint32_t            m_uMask;        /*当前块中尚未取出的命中位*/
+    };
+
+    /** @fn inline size_t CountChar(std::string_view s, char c)
+     *  @brief 统计字符c出现的次数，如统计行数
+     */
+    inline size_t CountChar(std::string_view s, char c)
+    {
+        const char* p = s.data();
+        const size_t n = s.length();
+        size_t nCount = 0;
+        size_t i = 0;
+#if defined(STRINGHELPER_SSE2) || defined(STRINGHELPER_AVX2)
+        // 命中时cmpeq为-1，逐字节累减到计数器中，最多255轮后用sad横向求和
+        const __m128i vc = _mm_set1_epi8(c);
+        while(i + 16 <= n)
+        {
+            __m128i acc = _mm_setzero_si128();
+            size_t uRounds = 0;
+            for(; i + 16 <= n && uRounds < 255; i += 16, ++uRounds)
+            {
+                acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), vc));
+            }
+            __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+            nCount += (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+        }
+#endif
+        for(; i < n; ++i)
+        {
+            nCount += (p[i] == c);
+        }
+        return nCount;
+    }
+
+    // 以字符串给出集合的便捷重载，每次调用都会构造集合
+    inline size_t FindFirstOf(std::string_view s, std::string_view chars, size_t pos = 0)
+    {
+        return FindFirstOf(s, CCharClass(chars), pos);
+    }
+
+    inline size_t FindFirstNotOf(std::string_view s, std::string_view chars, size_t pos = 0)
+    {
+        return FindFirstNotOf(s, CCharClass(chars), pos);
+    }
+
+    inline size_t FindLastOf(std::string_view s, std::string_view chars, size_t pos = std::string_view::npos)
+    {
+        return FindLastOf(s, CCharClass(chars), pos);
+    }
+
+    inline size_t FindLastNotOf(std::string_view s, std::string_view chars, size_t pos = std::string_view::npos)
+    {
+        return FindLastNotOf(s, CCharClass(chars), pos);
+    }
+}
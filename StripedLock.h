@@ -0,0 +1,226 @@
+/********************************************************************
+	filename: 	StripedLock.h
+
+	purpose:	分段锁表：N把独占缓存行的锁，按键的哈希选其一
+	            用来拆分保护整张表的全局锁：不同键多半落在不同段上，互不阻塞
+	            CGuard按单个键加锁；CMultiGuard同时锁住多个键，
+	            按段号升序加锁并去重，多处同时加多键锁也不会死锁；
+	            CAllGuard锁住全部段，用于统计、遍历、整体重建等少见操作
+	            同一线程不要在持有某段时再单独加另一段，需要多段时一次用CMultiGuard
+*********************************************************************/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <initializer_list>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "LockHelper.h"
+#include "FutexLock.h"
+
+template<class TLock = CFutexLock, size_t N = 64>
+class CStripedLock
+{
+    static_assert(N > 0 && 0 == (N & (N - 1)), "CStripedLock: N must be a power of two");
+
+public:
+    enum : size_t
+    {
+        STRIPES = N,
+    };
+
+    CStripedLock()
+    {
+    }
+
+private: // 拒绝拷贝
+    CStripedLock(const CStripedLock&);
+    CStripedLock& operator=(const CStripedLock&);
+
+public:
+    /** @fn template<class K> size_t StripeOf(const K& key) const
+     *  @brief 键所在的段号；std::hash对整数往往是恒等映射，再乘一次打散取高位
+     */
+    template<class K>
+    size_t StripeOf(const K& key) const
+    {
+        uint64_t uHash = (uint64_t)std::hash<K>()(key) * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(uHash >> 32) & (N - 1);
+    }
+
+    TLock& Stripe(size_t uIndex)
+    {
+        return m_stripes[uIndex & (N - 1)].lock;
+    }
+
+    template<class K>
+    TLock& LockFor(const K& key)
+    {
+        return Stripe(StripeOf(key));
+    }
+
+public:
+    // 锁住单个键所在的段
+    class CGuard
+    {
+    public:
+        template<class K>
+        CGuard(CStripedLock& stripes, const K& key)
+            : m_guard(&stripes.LockFor(key))
+        {
+        }
+
+    private: // 拒绝拷贝
+        CGuard(const CGuard&);
+        CGuard& operator=(const CGuard&);
+
+    private:
+        TLockHelper<TLock> m_guard;
+    };
+
+    // 锁住若干键所在的全部段，段号升序加锁、降序解锁，重复的段只加一次
+    class CMultiGuard
+    {
+    public:
+        template<class K>
+        CMultiGuard(CStripedLock& stripes, std::initializer_list<K> keys)
+            : m_stripes(stripes)
+        {
+            Clear();
+            for(const K& key : keys)
+            {
+                Mark(stripes.StripeOf(key));
+            }
+            LockMarked();
+        }
+
+        template<class TIter>
+        CMultiGuard(CStripedLock& stripes, TIter itBegin, TIter itEnd)
+            : m_stripes(stripes)
+        {
+            Clear();
+            for(; itBegin != itEnd; ++itBegin)
+            {
+                Mark(stripes.StripeOf(*itBegin));
+            }
+            LockMarked();
+        }
+
+        ~CMultiGuard()
+        {
+            for(size_t w = WORDS; w-- > 0; )
+            {
+                uint64_t uBits = m_uMarked[w];
+                while(uBits)
+                {
+                    int nBit = 63 - CountLeadingZeros(uBits);
+                    uBits &= ~((uint64_t)1 << nBit);
+                    m_stripes.Stripe(w * 64 + nBit).Unlock();
+                }
+            }
+        }
+
+    private: // 拒绝拷贝
+        CMultiGuard(const CMultiGuard&);
+        CMultiGuard& operator=(const CMultiGuard&);
+
+    private:
+        enum : size_t
+        {
+            WORDS = (N + 63) / 64,
+        };
+
+        void Clear()
+        {
+            for(size_t w = 0; w < WORDS; ++w)
+            {
+                m_uMarked[w] = 0;
+            }
+        }
+
+        void Mark(size_t uIndex)
+        {
+            m_uMarked[uIndex / 64] |= (uint64_t)1 << (uIndex % 64);
+        }
+
+        // 位图本身有序且无重复，按位从低到高加锁即为段号升序
+        void LockMarked()
+        {
+            for(size_t w = 0; w < WORDS; ++w)
+            {
+                uint64_t uBits = m_uMarked[w];
+                while(uBits)
+                {
+                    int nBit = CountTrailingZeros(uBits);
+                    uBits &= uBits - 1;
+                    m_stripes.Stripe(w * 64 + nBit).Lock();
+                }
+            }
+        }
+
+        static int CountTrailingZeros(uint64_t uBits)
+        {
+#ifdef _MSC_VER
+            unsigned long uIndex;
+            _BitScanForward64(&uIndex, uBits);
+            return (int)uIndex;
+#else
+            return __builtin_ctzll(uBits);
+#endif
+        }
+
+        static int CountLeadingZeros(uint64_t uBits)
+        {
+#ifdef _MSC_VER
+            unsigned long uIndex;
+            _BitScanReverse64(&uIndex, uBits);
+            return 63 - (int)uIndex;
+#else
+            return __builtin_clzll(uBits);
+#endif
+        }
+
+    private:
+        CStripedLock&   m_stripes;
+        uint64_t        m_uMarked[WORDS];   /*要锁的段号位图*/
+    };
+
+    // 按段号升序锁住全部段
+    class CAllGuard
+    {
+    public:
+        explicit CAllGuard(CStripedLock& stripes)
+            : m_stripes(stripes)
+        {
+            for(size_t i = 0; i < N; ++i)
+            {
+                m_stripes.Stripe(i).Lock();
+            }
+        }
+
+        ~CAllGuard()
+        {
+            for(size_t i = N; i-- > 0; )
+            {
+                m_stripes.Stripe(i).Unlock();
+            }
+        }
+
+    private: // 拒绝拷贝
+        CAllGuard(const CAllGuard&);
+        CAllGuard& operator=(const CAllGuard&);
+
+    private:
+        CStripedLock& m_stripes;
+    };
+
+private:
+    // 每段独占缓存行，相邻段的加解锁不会互相让对方的缓存行失效
+    struct alignas(64) StripeSlot
+    {
+        TLock lock;
+    };
+
+    StripeSlot m_stripes[N];
+};
@@ -0,0 +1,667 @@
+/********************************************************************
+	filename: 	ThreadPool.h
+
+	purpose:	工作窃取线程池，代替“一个任务一个线程”
+	            每个工作线程（CWorkThreadBase派生）有一个Chase-Lev双端队列：
+	            本线程从底部压入/弹出（无竞争时没有原子读改写），空闲线程从其他队列顶部窃取
+	            池外线程提交的任务进公共注入队列，由任意空闲线程取走
+	            Submit返回std::future；CTaskGroup/Invoke/ParallelFor用于fork/join，
+	            等待方在等待期间帮忙执行任务，工作线程里嵌套等待不会把池耗尽
+	            线程数默认等于CPU核数，各子系统共用CThreadPool::Global()即可
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <deque>
+#include <string>
+#include <exception>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <limits.h>
+#include <stdint.h>
+#include "WorkThreadBase.h"
+#include "FutexLock.h"
+
+namespace PoolDetail
+{
+    struct CTask
+    {
+        virtual ~CTask()
+        {
+        }
+        virtual void Run() = 0;
+    };
+
+    template<class Fn>
+    struct CFnTask : public CTask
+    {
+        template<class F>
+        explicit CFnTask(F&& f)
+            : fn(std::forward<F>(f))
+        {
+        }
+
+        void Run()
+        {
+            fn();
+        }
+
+        Fn fn;
+    };
+
+    template<class Fn>
+    inline CTask* MakeTask(Fn&& fn)
+    {
+        return new CFnTask<typename std::decay<Fn>::type>(std::forward<Fn>(fn));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Chase-Lev工作窃取双端队列（Lê等人的C11内存模型版本）
+// Push/Pop只能由所有者线程调用，Steal任意线程可调用；满时所有者把数组扩大一倍
+//////////////////////////////////////////////////////////////////////////
+template<class T>
+class CWorkStealingDeque
+{
+public:
+    explicit CWorkStealingDeque(size_t nInitCapacity = 256)
+        : m_nTop(0)
+        , m_nBottom(0)
+    {
+        size_t uSize = 2;
+        while(uSize < nInitCapacity)
+        {
+            uSize <<= 1;
+        }
+        Array* pArray = new Array(uSize);
+        m_vecArrays.push_back(pArray);
+        m_pArray.store(pArray, std::memory_order_relaxed);
+    }
+
+    // 析构时须已没有窃取者
+    ~CWorkStealingDeque()
+    {
+        for(size_t i = 0; i < m_vecArrays.size(); ++i)
+        {
+            delete m_vecArrays[i];
+        }
+    }
+
+private: // 拒绝拷贝
+    CWorkStealingDeque(const CWorkStealingDeque&);
+    CWorkStealingDeque& operator=(const CWorkStealingDeque&);
+
+public:
+    void Push(T value)
+    {
+        int64_t nBottom = m_nBottom.load(std::memory_order_relaxed);
+        int64_t nTop = m_nTop.load(std::memory_order_acquire);
+        Array* pArray = m_pArray.load(std::memory_order_relaxed);
+        if(nBottom - nTop > (int64_t)pArray->uMask)
+        {
+            pArray = Grow(pArray, nTop, nBottom);
+        }
+        pArray->Put(nBottom, value);
+        m_nBottom.store(nBottom + 1, std::memory_order_release);
+    }
+
+    bool Pop(T& value)
+    {
+        int64_t nBottom = m_nBottom.load(std::memory_order_relaxed) - 1;
+        Array* pArray = m_pArray.load(std::memory_order_relaxed);
+        m_nBottom.store(nBottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t nTop = m_nTop.load(std::memory_order_relaxed);
+        if(nTop > nBottom)
+        {
+            m_nBottom.store(nBottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = pArray->Get(nBottom);
+        if(nTop == nBottom)
+        {
+            // 只剩最后一个，与窃取者在top上竞争
+            bool bWon = m_nTop.compare_exchange_strong(nTop, nTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_nBottom.store(nBottom + 1, std::memory_order_relaxed);
+            return bWon;
+        }
+        return true;
+    }
+
+    bool Steal(T& value)
+    {
+        int64_t nTop = m_nTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t nBottom = m_nBottom.load(std::memory_order_acquire);
+        if(nTop >= nBottom)
+        {
+            return false;
+        }
+        Array* pArray = m_pArray.load(std::memory_order_acquire);
+        value = pArray->Get(nTop);
+        return m_nTop.compare_exchange_strong(nTop, nTop + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // 近似判空，用于睡眠前的复查
+    bool IsEmpty() const
+    {
+        return m_nBottom.load(std::memory_order_relaxed) <= m_nTop.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(size_t uSize)
+            : uMask(uSize - 1)
+            , pSlots(new std::atomic<T>[uSize])
+        {
+        }
+
+        ~Array()
+        {
+            delete[] pSlots;
+        }
+
+        T Get(int64_t nIndex) const
+        {
+            return pSlots[nIndex & uMask].load(std::memory_order_relaxed);
+        }
+
+        void Put(int64_t nIndex, T value)
+        {
+            pSlots[nIndex & uMask].store(value, std::memory_order_relaxed);
+        }
+
+        size_t          uMask;
+        std::atomic<T>* pSlots;
+    };
+
+    // 旧数组可能仍被窃取者读取，留到析构时统一释放
+    Array* Grow(Array* pOld, int64_t nTop, int64_t nBottom)
+    {
+        Array* pNew = new Array((pOld->uMask + 1) * 2);
+        for(int64_t i = nTop; i < nBottom; ++i)
+        {
+            pNew->Put(i, pOld->Get(i));
+        }
+        m_vecArrays.push_back(pNew);
+        m_pArray.store(pNew, std::memory_order_release);
+        return pNew;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t>    m_nTop;     /*窃取端*/
+    alignas(64) std::atomic<int64_t>    m_nBottom;  /*所有者端*/
+    std::atomic<Array*>                 m_pArray;
+    std::vector<Array*>                 m_vecArrays;
+};
+
+class CThreadPool
+{
+public:
+    enum
+    {
+        SPIN_ROUNDS = 64,   // 找不到任务时先自旋这么多轮再睡眠
+    };
+
+    /** @fn CThreadPool(size_t nThreads = 0)
+     *  @param (IN) size_t nThreads 工作线程数，0表示CPU核数
+     */
+    explicit CThreadPool(size_t nThreads = 0)
+        : m_uInjectCount(0)
+        , m_uSleepers(0)
+        , m_uWorkSeq(0)
+        , m_uStopping(0)
+    {
+        if(0 == nThreads)
+        {
+            nThreads = std::thread::hardware_concurrency();
+        }
+        if(0 == nThreads)
+        {
+            nThreads = 1;
+        }
+        for(size_t i = 0; i < nThreads; ++i)
+        {
+            m_vecWorkers.push_back(new CWorker(this, i));
+        }
+        for(size_t i = 0; i < nThreads; ++i)
+        {
+            m_vecWorkers[i]->Start();
+        }
+    }
+
+    ~CThreadPool()
+    {
+        Shutdown();
+    }
+
+    // 进程级共享池，永不析构
+    static CThreadPool& Global()
+    {
+        static CThreadPool* s_pPool = new CThreadPool;
+        return *s_pPool;
+    }
+
+private: // 拒绝拷贝
+    CThreadPool(const CThreadPool&);
+    CThreadPool& operator=(const CThreadPool&);
+
+public:
+    /** @fn template<class Fn> std::future<R> Submit(Fn&& fn)
+     *  @brief 提交任务，返回其结果；fn抛出的异常由future.get()重新抛出
+     */
+    template<class Fn>
+    std::future<typename std::invoke_result<typename std::decay<Fn>::type&>::type> Submit(Fn&& fn)
+    {
+        typedef typename std::invoke_result<typename std::decay<Fn>::type&>::type R;
+        std::packaged_task<R()> task(std::forward<Fn>(fn));
+        std::future<R> fut = task.get_future();
+        Post([task = std::move(task)]() mutable
+        {
+            task();
+        });
+        return fut;
+    }
+
+    // 提交不需要结果的任务；fn不得抛出异常
+    template<class Fn>
+    void Post(Fn&& fn)
+    {
+        Schedule(PoolDetail::MakeTask(std::forward<Fn>(fn)));
+    }
+
+    // fork/join：并行执行两个函数，都完成后返回
+    template<class Fn1, class Fn2>
+    void Invoke(Fn1&& fn1, Fn2&& fn2);
+
+    /** @fn template<class Fn> void ParallelFor(size_t uBegin, size_t uEnd, size_t uGrain, const Fn& fn)
+     *  @brief 对[uBegin, uEnd)中每个i调用fn(i)，区间递归二分，不超过uGrain个的小段串行执行
+     */
+    template<class Fn>
+    void ParallelFor(size_t uBegin, size_t uEnd, size_t uGrain, const Fn& fn);
+
+    /** @fn bool RunOne()
+     *  @brief 取一个待执行的任务在当前线程执行，没有则返回false；等待fork/join结果时用于帮忙
+     */
+    bool RunOne()
+    {
+        CWorker* pSelf = LocalWorker();
+        PoolDetail::CTask* pTask = FindWork((pSelf && pSelf->m_pPool == this) ? pSelf : NULL);
+        if(NULL == pTask)
+        {
+            return false;
+        }
+        Execute(pTask);
+        return true;
+    }
+
+    // 执行完所有已提交的任务后结束全部工作线程；之后不能再提交
+    void Shutdown()
+    {
+        if(m_vecWorkers.empty())
+        {
+            return;
+        }
+        m_uStopping.store(1);
+        m_uWorkSeq.fetch_add(1);
+        LockDetail::FutexWake(&m_uWorkSeq, INT_MAX);
+        for(size_t i = 0; i < m_vecWorkers.size(); ++i)
+        {
+            m_vecWorkers[i]->Halt();
+        }
+        for(size_t i = 0; i < m_vecWorkers.size(); ++i)
+        {
+            delete m_vecWorkers[i];
+        }
+        m_vecWorkers.clear();
+    }
+
+    size_t Size() const
+    {
+        return m_vecWorkers.size();
+    }
+
+    // 当前线程是否为本池的工作线程
+    bool IsWorkerThread() const
+    {
+        CWorker* pSelf = LocalWorker();
+        return pSelf && pSelf->m_pPool == this;
+    }
+
+private:
+    class CWorker : public CWorkThreadBase
+    {
+    public:
+        CWorker(CThreadPool* pPool, size_t nIndex)
+            : m_pPool(pPool)
+            , m_nIndex(nIndex)
+            , m_uRand((uint32_t)nIndex * 2654435761u + 1)
+        {
+            SetThreadName("pool-" + std::to_string(nIndex));
+        }
+
+        ~CWorker()
+        {
+            StopAndWait();
+        }
+
+        void Start()
+        {
+            Run();
+        }
+
+        void Halt()
+        {
+            Stop();
+        }
+
+    protected:
+        virtual void DoWork()
+        {
+            m_pPool->WorkerLoop(this);
+        }
+
+    public:
+        CThreadPool*                                m_pPool;
+        size_t                                      m_nIndex;
+        uint32_t                                    m_uRand;    /*选窃取对象用的随机数状态*/
+        CWorkStealingDeque<PoolDetail::CTask*>      m_deque;
+    };
+
+    static CWorker*& LocalWorker()
+    {
+        static thread_local CWorker* s_pWorker = NULL;
+        return s_pWorker;
+    }
+
+    // 工作线程内提交进自己的队列（后进先出，缓存友好），池外提交进注入队列
+    void Schedule(PoolDetail::CTask* pTask)
+    {
+        CWorker* pSelf = LocalWorker();
+        if(pSelf && pSelf->m_pPool == this)
+        {
+            pSelf->m_deque.Push(pTask);
+        }
+        else
+        {
+            SCOPED_SAFELOCK(&m_injectLock);
+            m_dqInject.push_back(pTask);
+            m_uInjectCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        WakeOne();
+    }
+
+    void WakeOne()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_uSleepers.load(std::memory_order_relaxed))
+        {
+            m_uWorkSeq.fetch_add(1);
+            LockDetail::FutexWake(&m_uWorkSeq, 1);
+        }
+    }
+
+    PoolDetail::CTask* PopInject()
+    {
+        if(0 == m_uInjectCount.load(std::memory_order_relaxed))
+        {
+            return NULL;
+        }
+        SCOPED_SAFELOCK(&m_injectLock);
+        if(m_dqInject.empty())
+        {
+            return NULL;
+        }
+        PoolDetail::CTask* pTask = m_dqInject.front();
+        m_dqInject.pop_front();
+        m_uInjectCount.fetch_sub(1, std::memory_order_relaxed);
+        return pTask;
+    }
+
+    // pSelf为NULL表示池外线程，只能取注入队列和窃取
+    PoolDetail::CTask* FindWork(CWorker* pSelf)
+    {
+        PoolDetail::CTask* pTask = NULL;
+        if(pSelf && pSelf->m_deque.Pop(pTask))
+        {
+            return pTask;
+        }
+        pTask = PopInject();
+        if(pTask)
+        {
+            return pTask;
+        }
+
+        size_t nCount = m_vecWorkers.size();
+        size_t nStart = 0;
+        if(pSelf)
+        {
+            pSelf->m_uRand ^= pSelf->m_uRand << 13;
+            pSelf->m_uRand ^= pSelf->m_uRand >> 17;
+            pSelf->m_uRand ^= pSelf->m_uRand << 5;
+            nStart = pSelf->m_uRand % nCount;
+        }
+        for(size_t i = 0; i < nCount; ++i)
+        {
+            CWorker* pVictim = m_vecWorkers[(nStart + i) % nCount];
+            if(pVictim != pSelf && pVictim->m_deque.Steal(pTask))
+            {
+                return pTask;
+            }
+        }
+        return NULL;
+    }
+
+    bool HasWork() const
+    {
+        if(m_uInjectCount.load(std::memory_order_relaxed))
+        {
+            return true;
+        }
+        for(size_t i = 0; i < m_vecWorkers.size(); ++i)
+        {
+            if(!m_vecWorkers[i]->m_deque.IsEmpty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void Execute(PoolDetail::CTask* pTask)
+    {
+        pTask->Run();
+        delete pTask;
+    }
+
+    void WorkerLoop(CWorker* pSelf)
+    {
+        LocalWorker() = pSelf;
+        int nIdle = 0;
+        while(true)
+        {
+            PoolDetail::CTask* pTask = FindWork(pSelf);
+            if(pTask)
+            {
+                Execute(pTask);
+                nIdle = 0;
+                continue;
+            }
+            if(m_uStopping.load())
+            {
+                break;
+            }
+            if(++nIdle < SPIN_ROUNDS)
+            {
+                LockDetail::CpuRelax();
+                continue;
+            }
+
+            // 先登记再复查，提交方要么看到登记而唤醒，要么本线程复查时看到任务
+            uint32_t uSeq = m_uWorkSeq.load(std::memory_order_acquire);
+            m_uSleepers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!HasWork() && !m_uStopping.load())
+            {
+                LockDetail::FutexWait(&m_uWorkSeq, uSeq);
+            }
+            m_uSleepers.fetch_sub(1);
+            nIdle = 0;
+        }
+        LocalWorker() = NULL;
+    }
+
+private:
+    std::vector<CWorker*>               m_vecWorkers;
+    CFutexLock                          m_injectLock;
+    std::deque<PoolDetail::CTask*>      m_dqInject;         /*池外提交的任务*/
+    std::atomic<size_t>                 m_uInjectCount;
+    alignas(64) std::atomic<uint32_t>   m_uSleepers;        /*睡眠中的工作线程数*/
+    std::atomic<uint32_t>               m_uWorkSeq;         /*睡眠线程的futex字*/
+    std::atomic<uint32_t>               m_uStopping;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// 一组fork出去的任务，Wait等待全部完成；等待期间当前线程帮忙执行池中的任务
+// 任务抛出的第一个异常在Wait中重新抛出；析构时会等待但不抛出
+//////////////////////////////////////////////////////////////////////////
+class CTaskGroup
+{
+public:
+    explicit CTaskGroup(CThreadPool& pool = CThreadPool::Global())
+        : m_pool(pool)
+        , m_uPending(0)
+        , m_bFailed(false)
+    {
+    }
+
+    ~CTaskGroup()
+    {
+        Join();
+    }
+
+private: // 拒绝拷贝
+    CTaskGroup(const CTaskGroup&);
+    CTaskGroup& operator=(const CTaskGroup&);
+
+public:
+    template<class Fn>
+    void Run(Fn&& fn)
+    {
+        m_uPending.fetch_add(1, std::memory_order_relaxed);
+        m_pool.Post([this, fn = std::forward<Fn>(fn)]() mutable
+        {
+            try
+            {
+                fn();
+            }
+            catch(...)
+            {
+                SetException(std::current_exception());
+            }
+            Done();
+        });
+    }
+
+    void Wait()
+    {
+        Join();
+        if(m_bFailed.load(std::memory_order_acquire))
+        {
+            m_bFailed.store(false, std::memory_order_relaxed);
+            std::exception_ptr pExcept = m_pExcept;
+            m_pExcept = NULL;
+            std::rethrow_exception(pExcept);
+        }
+    }
+
+private:
+    void Join()
+    {
+        while(true)
+        {
+            uint32_t uPending = m_uPending.load(std::memory_order_acquire);
+            if(0 == uPending)
+            {
+                break;
+            }
+            if(m_pool.RunOne())
+            {
+                continue;
+            }
+            // 剩下的任务都在别的线程上执行，短暂睡眠，醒来再看有没有可帮忙的
+            LockDetail::FutexWait(&m_uPending, uPending, 1);
+        }
+    }
+
+    void Done()
+    {
+        if(1 == m_uPending.fetch_sub(1, std::memory_order_acq_rel))
+        {
+            LockDetail::FutexWake(&m_uPending, INT_MAX);
+        }
+    }
+
+    void SetException(std::exception_ptr pExcept)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        if(!m_bFailed.load(std::memory_order_relaxed))
+        {
+            m_pExcept = pExcept;
+            m_bFailed.store(true, std::memory_order_release);
+        }
+    }
+
+private:
+    CThreadPool&            m_pool;
+    std::atomic<uint32_t>   m_uPending;     /*未完成的任务数*/
+    std::atomic<bool>       m_bFailed;
+    CFutexLock              m_lock;
+    std::exception_ptr      m_pExcept;
+};
+
+template<class Fn1, class Fn2>
+inline void CThreadPool::Invoke(Fn1&& fn1, Fn2&& fn2)
+{
+    CTaskGroup group(*this);
+    group.Run(std::forward<Fn2>(fn2));
+    fn1();
+    group.Wait();
+}
+
+namespace PoolDetail
+{
+    template<class Fn>
+    void ParallelForRange(CTaskGroup& group, size_t uBegin, size_t uEnd, size_t uGrain, const Fn& fn)
+    {
+        // 右半段fork出去，左半段留在本线程继续二分
+        while(uEnd - uBegin > uGrain)
+        {
+            size_t uMid = uBegin + (uEnd - uBegin) / 2;
+            group.Run([&group, uMid, uEnd, uGrain, &fn]()
+            {
+                ParallelForRange(group, uMid, uEnd, uGrain, fn);
+            });
+            uEnd = uMid;
+        }
+        for(size_t i = uBegin; i < uEnd; ++i)
+        {
+            fn(i);
+        }
+    }
+}
+
+template<class Fn>
+inline void CThreadPool::ParallelFor(size_t uBegin, size_t uEnd, size_t uGrain, const Fn& fn)
+{
+    if(uBegin >= uEnd)
+    {
+        return;
+    }
+    CTaskGroup group(*this);
+    PoolDetail::ParallelForRange(group, uBegin, uEnd, uGrain ? uGrain : 1, fn);
+    group.Wait();
+}
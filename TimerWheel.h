@@ -0,0 +1,490 @@
+/********************************************************************
+	filename: 	TimerWheel.h
+
+	purpose:	分层哈希时间轮，大量定时器（巡检、重试、超时）的统一调度
+	            CTimingWheel：4层×256槽，按到期刻度哈希进槽，增加、取消都是O(1)，
+	                每走一格只处理一个槽，低层转完一圈时把上一层的一个槽下放；单线程使用
+	            CTimerService：CWorkThreadBase派生的定时线程，按粗粒度刻度（默认10ms）推进时间轮，
+	                同一刻度到期的回调成批投递到CThreadPool执行，定时线程自己不跑业务
+	            到期时间精度为一个刻度；回调可能在Cancel返回后仍在执行（已投递出去的那一次）
+*********************************************************************/
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "WorkThreadBase.h"
+#include "ThreadPool.h"
+#include "FutexLock.h"
+
+typedef uint64_t TimerId;   // 0为无效值
+
+class CTimingWheel
+{
+public:
+    enum
+    {
+        LEVELS      = 4,
+        SLOT_BITS   = 8,
+        SLOTS       = 1 << SLOT_BITS,
+    };
+
+    explicit CTimingWheel(uint64_t uStartTick = 0)
+        : m_uCurTick(uStartTick)
+        , m_nFree(-1)
+        , m_nCount(0)
+    {
+        for(int l = 0; l < LEVELS; ++l)
+        {
+            for(int s = 0; s < SLOTS; ++s)
+            {
+                m_nHeads[l][s] = -1;
+            }
+        }
+    }
+
+private: // 拒绝拷贝
+    CTimingWheel(const CTimingWheel&);
+    CTimingWheel& operator=(const CTimingWheel&);
+
+public:
+    /** @fn TimerId Add(uint64_t uDelayTicks, uint64_t uPeriodTicks, std::function<void()> fn)
+     *  @brief 在uDelayTicks个刻度后触发（至少1），uPeriodTicks非0时此后每隔该刻度数重复触发
+     */
+    TimerId Add(uint64_t uDelayTicks, uint64_t uPeriodTicks, std::function<void()> fn)
+    {
+        int32_t nIndex = AllocNode();
+        Node& node = m_vecNodes[nIndex];
+        node.uExpire = m_uCurTick + (uDelayTicks ? uDelayTicks : 1);
+        node.uPeriod = uPeriodTicks;
+        node.fn = std::move(fn);
+        node.bActive = true;
+        Place(nIndex);
+        ++m_nCount;
+        return ((uint64_t)node.uGen << 32) | (uint32_t)(nIndex + 1);
+    }
+
+    // 取消未触发的定时器；已触发的一次性定时器或无效ID返回false
+    bool Cancel(TimerId id)
+    {
+        int32_t nIndex = (int32_t)(uint32_t)id - 1;
+        if(nIndex < 0 || nIndex >= (int32_t)m_vecNodes.size())
+        {
+            return false;
+        }
+        Node& node = m_vecNodes[nIndex];
+        if(!node.bActive || node.uGen != (uint32_t)(id >> 32))
+        {
+            return false;
+        }
+        Unlink(nIndex);
+        FreeNode(nIndex);
+        --m_nCount;
+        return true;
+    }
+
+    /** @fn void Advance(uint64_t uToTick, std::vector<std::function<void()> >& vecFired)
+     *  @brief 推进到uToTick（含），到期回调追加到vecFired由调用方执行；
+     *    周期定时器的回调是副本，已重新排入下一周期
+     */
+    void Advance(uint64_t uToTick, std::vector<std::function<void()> >& vecFired)
+    {
+        if(0 == m_nCount && uToTick > m_uCurTick)
+        {
+            m_uCurTick = uToTick;   // 空轮直接跳过，不逐格走
+            return;
+        }
+        while(m_uCurTick < uToTick)
+        {
+            ++m_uCurTick;
+            Cascade();
+            Expire(vecFired);
+        }
+    }
+
+    /** @fn uint64_t TicksToNextEvent() const
+     *  @brief 距离下一次需要推进的刻度数：最近的非空底层槽，或下一次下放；没有定时器时返回UINT64_MAX
+     *    用作epoll等的超时，过早醒来无害
+     */
+    uint64_t TicksToNextEvent() const
+    {
+        if(0 == m_nCount)
+        {
+            return UINT64_MAX;
+        }
+        uint64_t uBoundary = SLOTS - (m_uCurTick & (SLOTS - 1));
+        for(uint64_t d = 1; d < uBoundary; ++d)
+        {
+            if(m_nHeads[0][(m_uCurTick + d) & (SLOTS - 1)] >= 0)
+            {
+                return d;
+            }
+        }
+        return uBoundary;
+    }
+
+    uint64_t CurrentTick() const
+    {
+        return m_uCurTick;
+    }
+
+    size_t Count() const
+    {
+        return (size_t)m_nCount;
+    }
+
+private:
+    struct Node
+    {
+        Node()
+            : uExpire(0)
+            , uPeriod(0)
+            , uGen(0)
+            , nPrev(-1)
+            , nNext(-1)
+            , nLevel(0)
+            , nSlot(0)
+            , bActive(false)
+        {
+        }
+
+        uint64_t                uExpire;    /*到期刻度*/
+        uint64_t                uPeriod;    /*0为一次性*/
+        uint32_t                uGen;       /*节点复用时递增，使旧ID失效*/
+        int32_t                 nPrev;
+        int32_t                 nNext;      /*空闲时为空闲链表的下一个*/
+        int16_t                 nLevel;
+        int16_t                 nSlot;
+        bool                    bActive;
+        std::function<void()>   fn;
+    };
+
+    int32_t AllocNode()
+    {
+        if(m_nFree >= 0)
+        {
+            int32_t nIndex = m_nFree;
+            m_nFree = m_vecNodes[nIndex].nNext;
+            return nIndex;
+        }
+        m_vecNodes.push_back(Node());
+        return (int32_t)m_vecNodes.size() - 1;
+    }
+
+    void FreeNode(int32_t nIndex)
+    {
+        Node& node = m_vecNodes[nIndex];
+        node.bActive = false;
+        node.fn = nullptr;
+        ++node.uGen;
+        node.nNext = m_nFree;
+        m_nFree = nIndex;
+    }
+
+    // 按与当前刻度的距离选层：差值小于256^(l+1)的放第l层，槽号取到期刻度的第l段8位
+    void Place(int32_t nIndex)
+    {
+        Node& node = m_vecNodes[nIndex];
+        uint64_t uExpire = node.uExpire;
+        if(uExpire < m_uCurTick)
+        {
+            uExpire = m_uCurTick;
+        }
+        uint64_t uDiff = uExpire - m_uCurTick;
+        int nLevel = 0;
+        while(nLevel < LEVELS - 1 && uDiff >= ((uint64_t)1 << (SLOT_BITS * (nLevel + 1))))
+        {
+            ++nLevel;
+        }
+        if(LEVELS - 1 == nLevel && uDiff >= ((uint64_t)1 << (SLOT_BITS * LEVELS)))
+        {
+            // 超出最大跨度，先放在最高层最远处，下放时再按真实到期时间重排
+            uExpire = m_uCurTick + ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+        }
+        int nSlot = (int)((uExpire >> (SLOT_BITS * nLevel)) & (SLOTS - 1));
+
+        node.nLevel = (int16_t)nLevel;
+        node.nSlot = (int16_t)nSlot;
+        node.nPrev = -1;
+        node.nNext = m_nHeads[nLevel][nSlot];
+        if(node.nNext >= 0)
+        {
+            m_vecNodes[node.nNext].nPrev = nIndex;
+        }
+        m_nHeads[nLevel][nSlot] = nIndex;
+    }
+
+    void Unlink(int32_t nIndex)
+    {
+        Node& node = m_vecNodes[nIndex];
+        if(node.nPrev >= 0)
+        {
+            m_vecNodes[node.nPrev].nNext = node.nNext;
+        }
+        else
+        {
+            m_nHeads[node.nLevel][node.nSlot] = node.nNext;
+        }
+        if(node.nNext >= 0)
+        {
+            m_vecNodes[node.nNext].nPrev = node.nPrev;
+        }
+    }
+
+    // 底层转完一圈时下放第1层对应槽，第1层也转完一圈再下放第2层，依此类推
+    void Cascade()
+    {
+        for(int l = 1; l < LEVELS; ++l)
+        {
+            if(m_uCurTick & (((uint64_t)1 << (SLOT_BITS * l)) - 1))
+            {
+                break;
+            }
+            int nSlot = (int)((m_uCurTick >> (SLOT_BITS * l)) & (SLOTS - 1));
+            int32_t nIndex = m_nHeads[l][nSlot];
+            m_nHeads[l][nSlot] = -1;
+            while(nIndex >= 0)
+            {
+                int32_t nNext = m_vecNodes[nIndex].nNext;
+                Place(nIndex);
+                nIndex = nNext;
+            }
+        }
+    }
+
+    void Expire(std::vector<std::function<void()> >& vecFired)
+    {
+        int nSlot = (int)(m_uCurTick & (SLOTS - 1));
+        int32_t nIndex = m_nHeads[0][nSlot];
+        m_nHeads[0][nSlot] = -1;
+        while(nIndex >= 0)
+        {
+            Node& node = m_vecNodes[nIndex];
+            int32_t nNext = node.nNext;
+            if(node.uPeriod)
+            {
+                vecFired.push_back(node.fn);
+                node.uExpire = m_uCurTick + node.uPeriod;
+                Place(nIndex);
+            }
+            else
+            {
+                vecFired.push_back(std::move(node.fn));
+                FreeNode(nIndex);
+                --m_nCount;
+            }
+            nIndex = nNext;
+        }
+    }
+
+private:
+    uint64_t            m_uCurTick;     /*已处理到的刻度*/
+    std::vector<Node>   m_vecNodes;
+    int32_t             m_nFree;        /*空闲节点链表头*/
+    int64_t             m_nCount;       /*未触发的定时器数*/
+    int32_t             m_nHeads[LEVELS][SLOTS];
+};
+
+class CTimerService : public CWorkThreadBase
+{
+public:
+    enum
+    {
+        DISPATCH_BATCH = 32,    // 每个线程池任务携带的回调数
+    };
+
+    /** @fn CTimerService(CThreadPool* pPool = &CThreadPool::Global(), uint32_t uTickMs = 10)
+     *  @param (IN) CThreadPool* pPool 回调执行的线程池，NULL时在定时线程上直接执行（回调须很短）
+     *  @param (IN) uint32_t uTickMs 刻度长度，即定时精度
+     */
+    explicit CTimerService(CThreadPool* pPool = &CThreadPool::Global(), uint32_t uTickMs = 10)
+        : m_pPool(pPool)
+        , m_uTickMs(uTickMs ? uTickMs : 1)
+        , m_tpStart(std::chrono::steady_clock::now())
+        , m_uWakeSeq(0)
+        , m_stopCallback(GetStopToken(), [this]() { Wake(); })
+    {
+        SetThreadName("timer");
+    }
+
+    ~CTimerService()
+    {
+        StopAndWait();
+    }
+
+    // 进程级共享的定时服务，首次使用时启动，永不析构
+    static CTimerService& Global()
+    {
+        static CTimerService* s_pService = CreateGlobal();
+        return *s_pService;
+    }
+
+public:
+    void Start()
+    {
+        Run();
+    }
+
+    /** @fn bool Shutdown(uint32_t uTimeoutMs = (uint32_t)-1)
+     *  @brief 停止定时线程，默认等到线程退出；滚动重启等需要限时返回的场合传入超时
+     *  @return bool 线程已退出返回true；超时返回false，线程仍归本对象所有，析构时会等它退出
+     */
+    bool Shutdown(uint32_t uTimeoutMs = (uint32_t)-1)
+    {
+        return StopFor(uTimeoutMs);
+    }
+
+    // 延迟uDelayMs毫秒执行一次
+    TimerId AddTimer(uint32_t uDelayMs, std::function<void()> fn)
+    {
+        return Add(uDelayMs, 0, std::move(fn));
+    }
+
+    // 延迟uDelayMs毫秒后首次执行，此后每uPeriodMs毫秒执行一次
+    TimerId AddPeriodic(uint32_t uDelayMs, uint32_t uPeriodMs, std::function<void()> fn)
+    {
+        return Add(uDelayMs, uPeriodMs ? uPeriodMs : 1, std::move(fn));
+    }
+
+    bool Cancel(TimerId id)
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        return m_wheel.Cancel(id);
+    }
+
+    size_t Count()
+    {
+        SCOPED_SAFELOCK(&m_lock);
+        return m_wheel.Count();
+    }
+
+protected:
+    virtual void DoWork()
+    {
+        std::vector<std::function<void()> > vecFired;
+        while(IsThrdRunning())
+        {
+            uint32_t uSeq = m_uWakeSeq.load(std::memory_order_acquire);
+            uint64_t uWaitTicks = 0;
+            uint64_t uCurTick = 0;
+            {
+                SCOPED_SAFELOCK(&m_lock);
+                m_wheel.Advance(NowTick(), vecFired);
+                uWaitTicks = m_wheel.TicksToNextEvent();
+                uCurTick = m_wheel.CurrentTick();
+            }
+            Dispatch(vecFired);
+            if(!IsThrdRunning())
+            {
+                break;
+            }
+
+            // 睡到下一个有事的刻度，期间新加的更早的定时器会把线程唤醒重算
+            uint32_t uWaitMs = (uint32_t)-1;
+            if(uWaitTicks != UINT64_MAX)
+            {
+                uint64_t uTargetMs = (uCurTick + uWaitTicks) * m_uTickMs;
+                uint64_t uElapsedMs = ElapsedMs();
+                uint64_t uMs = (uTargetMs > uElapsedMs) ? uTargetMs - uElapsedMs : 0;
+                uWaitMs = (uint32_t)((uMs > 0xFFFFFFF0u) ? 0xFFFFFFF0u : uMs);
+            }
+            LockDetail::FutexWait(&m_uWakeSeq, uSeq, uWaitMs);
+        }
+    }
+
+private:
+    static CTimerService* CreateGlobal()
+    {
+        CTimerService* pService = new CTimerService;
+        pService->Start();
+        return pService;
+    }
+
+    TimerId Add(uint32_t uDelayMs, uint32_t uPeriodMs, std::function<void()> fn)
+    {
+        // 向上取整：不早于要求的时间触发
+        uint64_t uDelayTicks = ((uint64_t)uDelayMs + m_uTickMs - 1) / m_uTickMs;
+        uint64_t uPeriodTicks = uPeriodMs ? (((uint64_t)uPeriodMs + m_uTickMs - 1) / m_uTickMs) : 0;
+        TimerId id = 0;
+        uint64_t uOldWait = 0;
+        uint64_t uNewWait = 0;
+        {
+            SCOPED_SAFELOCK(&m_lock);
+            // 定时线程可能还没推进到当前时刻，先对齐再计算到期刻度
+            uint64_t uNow = NowTick();
+            uOldWait = m_wheel.TicksToNextEvent();
+            if(m_wheel.CurrentTick() < uNow)
+            {
+                uDelayTicks += uNow - m_wheel.CurrentTick();
+            }
+            id = m_wheel.Add(uDelayTicks, uPeriodTicks, std::move(fn));
+            uNewWait = m_wheel.TicksToNextEvent();
+        }
+        if(uNewWait < uOldWait)
+        {
+            Wake();
+        }
+        return id;
+    }
+
+    // 到期回调按批投递，线程池中一个任务执行一批
+    void Dispatch(std::vector<std::function<void()> >& vecFired)
+    {
+        if(vecFired.empty())
+        {
+            return;
+        }
+        if(NULL == m_pPool)
+        {
+            for(size_t i = 0; i < vecFired.size(); ++i)
+            {
+                vecFired[i]();
+            }
+            vecFired.clear();
+            return;
+        }
+        for(size_t uBegin = 0; uBegin < vecFired.size(); uBegin += DISPATCH_BATCH)
+        {
+            size_t uEnd = (uBegin + DISPATCH_BATCH < vecFired.size()) ? uBegin + DISPATCH_BATCH : vecFired.size();
+            std::vector<std::function<void()> > vecBatch(
+                std::make_move_iterator(vecFired.begin() + uBegin),
+                std::make_move_iterator(vecFired.begin() + uEnd));
+            m_pPool->Post([vecBatch = std::move(vecBatch)]()
+            {
+                for(size_t i = 0; i < vecBatch.size(); ++i)
+                {
+                    vecBatch[i]();
+                }
+            });
+        }
+        vecFired.clear();
+    }
+
+    void Wake()
+    {
+        m_uWakeSeq.fetch_add(1, std::memory_order_release);
+        LockDetail::FutexWake(&m_uWakeSeq, 1);
+    }
+
+    uint64_t ElapsedMs() const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - m_tpStart).count();
+    }
+
+    uint64_t NowTick() const
+    {
+        return ElapsedMs() / m_uTickMs;
+    }
+
+private:
+    CThreadPool*                            m_pPool;
+    uint32_t                                m_uTickMs;
+    std::chrono::steady_clock::time_point   m_tpStart;  /*第0个刻度的起点*/
+    CFutexLock                              m_lock;     /*保护m_wheel*/
+    CTimingWheel                            m_wheel;
+    std::atomic<uint32_t>                   m_uWakeSeq; /*定时线程睡眠用的futex字*/
+    CStopCallback                           m_stopCallback; /*停止请求时唤醒定时线程*/
+};
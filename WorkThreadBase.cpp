@@ -1,7 +1,24 @@
 #include "StdAfx.h"
 #include "WorkThreadBase.h"
+#ifdef _WIN32
 #include <process.h>
+#else
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include "FutexLock.h"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1    // 取自<numaif.h>，免得依赖libnuma
+#endif
+#endif
 #include <cassert>
+#include <chrono>
+#include <limits.h>
 
 #ifndef NO_XLOGGING
 #include "Logging.h"
@@ -16,19 +33,26 @@
 #endif
 #endif
 
+#ifdef _WIN32
 CWorkThreadBase::CWorkThreadBase(DWORD dwHeartExitTime /* = INFINITE */)
     : m_hThread(NULL)
     , m_bThrdRunning(false)
     , m_uHeartTime(dwHeartExitTime)
     , m_dwThreadId((UINT)-1)
     , m_hExitEvent(NULL)
+    , m_hStartEvent(NULL)
+    , m_uStartState(0)
+    , m_nNumaNode(-1)
+    , m_ePriority(PRIORITY_DEFAULT)
+    , m_nRealtimeLevel(1)
 {
     m_hExitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hStartEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 }
 
 CWorkThreadBase::~CWorkThreadBase(void)
 {
-    Stop();
+    StopAndWait();
 
     // 析构时，先析构子类，再析构父类
     // 有些时候需要先结束线程，再做其他的资源释放工作，因此设定线程的结束必须有父类完成
@@ -40,6 +64,11 @@ CWorkThreadBase::~CWorkThreadBase(void)
         CloseHandle(m_hExitEvent);
         m_hExitEvent = NULL;
     }
+    if(m_hStartEvent)
+    {
+        CloseHandle(m_hStartEvent);
+        m_hStartEvent = NULL;
+    }
 }
 
 void CWorkThreadBase::Run()
@@ -55,10 +84,12 @@ void CWorkThreadBase::Run()
         }
     }
 
-    ResetEvent(m_hExitEvent);
-
     if(NULL == m_hThread)
     {
+        ResetEvent(m_hExitEvent);
+        ResetEvent(m_hStartEvent);
+        m_stopSource.Reset();
+        m_uStartState.store(0);
         m_hThread = (HANDLE)_beginthreadex(NULL, 0, ThreadProc, this, CREATE_SUSPENDED, &m_dwThreadId);
         if(-1 == (int)m_hThread)
 		{
@@ -87,12 +118,16 @@ void CWorkThreadBase::Run()
 #endif        
             m_bThrdRunning = true;
 			ResumeThread(m_hThread);
+
+            // 等线程建好消息队列再返回，之后的PostThreadMessage（包括Stop的WM_QUIT）不会因队列不存在而失败
+            WaitForSingleObject(m_hStartEvent, INFINITE);
 		} 
     }
 }
 
-void CWorkThreadBase::Stop()
+bool CWorkThreadBase::Stop()
 {
+    bool bStopped = true;
     if(m_hThread)
     {
 #ifndef NO_XLOGGING
@@ -100,28 +135,48 @@ void CWorkThreadBase::Stop()
         sprintf_s(chBuf, 128, "工作线程（id = %u）退出", m_dwThreadId);
         wPerformLogSys::CPerformLog oLog(chBuf);
 #endif
-      
-        // 三种退出标识
-        SetThrdRunning(false);
-        SetEvent(m_hExitEvent);
-        SurePostMessage(WM_QUIT, NULL, NULL);
-
-        DWORD dwCode = WaitForSingleObject(m_hThread, m_uHeartTime);
-        DWORD dwExitCode = 0;
-        if(dwCode != WAIT_OBJECT_0 && GetExitCodeThread(m_hThread, &dwExitCode) && dwExitCode == STILL_ACTIVE)
+        // 不再TerminateThread：强杀会留下未释放的锁和写了一半的数据，超时只告警，线程句柄仍由本对象持有
+        if(!StopFor(m_uHeartTime))
         {
 #ifndef NO_XLOGGING
-            LOG_WARN << "Thread: " << m_dwThreadId << " stopped not security.";
+            LOG_WARN << "Thread: " << m_dwThreadId << " stopped not in time.";
 #endif
-            TerminateThread(m_hThread, (DWORD)-1);
+            bStopped = false;
         }
+    }
 
-        CloseHandle(m_hThread);
-        m_hThread = NULL; 
+    assert(IsThrdRunning() == false);
+    return bStopped;
+}
+
+void CWorkThreadBase::RequestStop()
+{
+    // 三种退出标识，另触发停止令牌唤醒线程内的各类等待
+    SetThrdRunning(false);
+    m_stopSource.RequestStop();
+    if(m_hThread)
+    {
+        SetEvent(m_hExitEvent);
+        // Run已保证消息队列存在，投递一次即可，失败也不重试
+        PostThreadMessage(m_dwThreadId, WM_QUIT, NULL, NULL);
+    }
+}
+
+bool CWorkThreadBase::WaitStopped(uint32_t uTimeoutMs)
+{
+    if(NULL == m_hThread)
+    {
+        return true;
+    }
+    if(WaitForSingleObject(m_hThread, uTimeoutMs) != WAIT_OBJECT_0)
+    {
+        return false;
     }
 
+    CloseHandle(m_hThread);
+    m_hThread = NULL;
     ResetEvent(m_hExitEvent);
-    assert(IsThrdRunning() == false);
+    return true;
 }
 
 unsigned int __stdcall CWorkThreadBase::ThreadProc( LPVOID lpParam )
@@ -129,8 +184,16 @@ unsigned int __stdcall CWorkThreadBase::ThreadProc( LPVOID lpParam )
     assert(lpParam);
     CWorkThreadBase* pThis = (CWorkThreadBase*)lpParam;
 
+    // 先建立线程消息队列再放行Run，派生类的GetMessage循环不会漏掉WM_QUIT
+    MSG msg;
+    PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+    pThis->m_uStartState.store(1);
+    SetEvent(pThis->m_hStartEvent);
+
+    pThis->ApplyThreadOptions();
     pThis->DoWork();
     pThis->SetThrdRunning(false);
+    pThis->m_uStartState.store(2);
 
     _endthreadex(0);
     return 0;
@@ -138,12 +201,12 @@ unsigned int __stdcall CWorkThreadBase::ThreadProc( LPVOID lpParam )
 
 bool CWorkThreadBase::IsThrdRunning()
 {
-    return m_bThrdRunning;
+    return m_bThrdRunning.load(std::memory_order_acquire);
 }
 
 void CWorkThreadBase::SetThrdRunning( bool bRunning )
 {
-    m_bThrdRunning = bRunning;
+    m_bThrdRunning.store(bRunning, std::memory_order_release);
 }
 
 DWORD CWorkThreadBase::GetThreadId() const
@@ -158,17 +221,397 @@ HANDLE CWorkThreadBase::GetThreadHandle() const
 
 BOOL CWorkThreadBase::SurePostMessage(UINT uMsg, WPARAM wp /* = 0 */, LPARAM lp /* = 0 */)
 {
-    BOOL rlt = FALSE;
-    int times = 0;
-    do 
+    // Run返回前消息队列已建好，此时投递失败只会是队列已满（ERROR_NOT_ENOUGH_QUOTA）或线程已退出，
+    // Sleep重试只会卡住投递方，直接失败并告警，由调用方决定丢弃还是改走CMailboxThread::PostMsg
+    BOOL rlt = PostThreadMessage(m_dwThreadId, uMsg, wp, lp);
+    if(!rlt)
+    {
+#ifndef NO_XLOGGING
+        DWORD dwErr = GetLastError();
+        LOG_WARN << "PostThreadMessage failed. thread = " << m_dwThreadId << " msg = " << uMsg
+            << " error = " << dwErr;
+#endif
+    }
+    return rlt;
+}
+
+void CWorkThreadBase::ApplyThreadOptions()
+{
+    HANDLE hThread = GetCurrentThread();
+
+    // Windows默认从线程当前所在处理器的节点分配内存，绑定到节点的CPU即可让线程内的分配落在该节点
+    DWORD_PTR dwMask = 0;
+    for(size_t i = 0; i < m_vecCpus.size(); ++i)
+    {
+        if(m_vecCpus[i] >= 0 && m_vecCpus[i] < (int)(sizeof(DWORD_PTR) * 8))
+        {
+            dwMask |= (DWORD_PTR)1 << m_vecCpus[i];
+        }
+    }
+    if(m_vecCpus.empty() && m_nNumaNode >= 0)
     {
-        rlt = PostThreadMessage(m_dwThreadId, uMsg, wp, lp);
-        if(!rlt)
+        ULONGLONG ullNodeMask = 0;
+        if(GetNumaNodeProcessorMask((UCHAR)m_nNumaNode, &ullNodeMask))
         {
-            Sleep(100);
-            ++times;
+            dwMask = (DWORD_PTR)ullNodeMask;
         }
-    }while(!rlt && times < 5);	
+    }
+    if(dwMask != 0 && 0 == SetThreadAffinityMask(hThread, dwMask))
+    {
+#ifndef NO_XLOGGING
+        LOG_WARN << "SetThreadAffinityMask failed. thread = " << m_dwThreadId << " error = " << GetLastError();
+#endif
+    }
 
-    return rlt;
+    int nPriority = THREAD_PRIORITY_NORMAL;
+    switch(m_ePriority)
+    {
+    case PRIORITY_LOW:      nPriority = THREAD_PRIORITY_BELOW_NORMAL; break;
+    case PRIORITY_HIGH:     nPriority = THREAD_PRIORITY_HIGHEST; break;
+    case PRIORITY_REALTIME: nPriority = THREAD_PRIORITY_TIME_CRITICAL; break;
+    default: break;
+    }
+    if(m_ePriority != PRIORITY_DEFAULT && !SetThreadPriority(hThread, nPriority))
+    {
+#ifndef NO_XLOGGING
+        LOG_WARN << "SetThreadPriority failed. thread = " << m_dwThreadId << " error = " << GetLastError();
+#endif
+    }
+
+    if(!m_sThreadName.empty())
+    {
+        // SetThreadDescription自Windows 10 1607起才有，动态取地址以免在旧系统上加载失败
+        typedef HRESULT (WINAPI *PFN_SetThreadDescription)(HANDLE, PCWSTR);
+        PFN_SetThreadDescription pfn = (PFN_SetThreadDescription)GetProcAddress(
+            GetModuleHandleW(L"kernel32.dll"), "SetThreadDescription");
+        if(pfn)
+        {
+            wchar_t wszName[64] = {0};
+            MultiByteToWideChar(CP_ACP, 0, m_sThreadName.c_str(), -1, wszName, _countof(wszName) - 1);
+            pfn(hThread, wszName);
+        }
+    }
+}
+#else // _WIN32
+
+CWorkThreadBase::CWorkThreadBase(uint32_t uHeartExitTime /* = (uint32_t)-1 */)
+    : m_bHasThread(false)
+    , m_dwThreadId((unsigned int)-1)
+    , m_bThrdRunning(false)
+    , m_uHeartTime(uHeartExitTime)
+    , m_uStartState(0)
+    , m_nNumaNode(-1)
+    , m_ePriority(PRIORITY_DEFAULT)
+    , m_nRealtimeLevel(1)
+{
+}
+
+CWorkThreadBase::~CWorkThreadBase(void)
+{
+    StopAndWait();
+
+    // 同Windows版：线程必须在父类析构前结束
+    assert(m_bHasThread == false);
+    assert(m_bThrdRunning == false);
+}
+
+void CWorkThreadBase::Run()
+{
+    if(m_bHasThread && 2 == m_uStartState.load())
+    {
+        // 上一次的线程已自行退出，回收后重新创建
+        pthread_join(m_hThread, NULL);
+        m_bHasThread = false;
+    }
+
+    if(!m_bHasThread)
+    {
+        m_stopSource.Reset();
+        m_uStartState.store(0);
+        m_bThrdRunning = true;
+        int nErr = pthread_create(&m_hThread, NULL, ThreadProc, this);
+        if(nErr != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_ERROR << "Failed to create a new thread. errno = " << nErr;
+#endif
+            m_bThrdRunning = false;
+            return;
+        }
+        m_bHasThread = true;
+
+        // 等线程取得自己的ID，保证Run返回后GetThreadId可用（对应Windows版的CREATE_SUSPENDED）
+        while(0 == m_uStartState.load())
+        {
+            LockDetail::FutexWait(&m_uStartState, 0);
+        }
+#ifndef NO_XLOGGING
+        LOG_INFO << "启动工作线程：id = " << m_dwThreadId;
+#endif
+    }
+}
+
+bool CWorkThreadBase::Stop()
+{
+    bool bStopped = true;
+    if(m_bHasThread)
+    {
+#ifndef NO_XLOGGING
+        LOG_INFO << "工作线程（id = " << m_dwThreadId << "）退出";
+#endif
+        // Linux下没有安全的强杀手段，超过心跳时间只告警，线程仍由本对象持有，之后可再WaitStopped
+        if(!StopFor(m_uHeartTime))
+        {
+#ifndef NO_XLOGGING
+            LOG_WARN << "Thread: " << m_dwThreadId << " stopped not in time.";
+#endif
+            bStopped = false;
+        }
+    }
+
+    assert(IsThrdRunning() == false);
+    return bStopped;
+}
+
+void CWorkThreadBase::RequestStop()
+{
+    SetThrdRunning(false);
+    m_stopSource.RequestStop();
+}
+
+bool CWorkThreadBase::WaitStopped(uint32_t uTimeoutMs)
+{
+    if(!m_bHasThread)
+    {
+        return true;
+    }
+
+    // 在线程函数返回的标志上等，而不是pthread_timedjoin_np，免受系统时间调整影响
+    std::chrono::steady_clock::time_point tpDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(uTimeoutMs);
+    uint32_t uState = 0;
+    while((uState = m_uStartState.load()) != 2)
+    {
+        uint32_t uWaitMs = (uint32_t)-1;
+        if(uTimeoutMs != (uint32_t)-1)
+        {
+            std::chrono::steady_clock::time_point tpNow = std::chrono::steady_clock::now();
+            if(tpNow >= tpDeadline)
+            {
+                return false;
+            }
+            uWaitMs = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(tpDeadline - tpNow).count() + 1;
+        }
+        LockDetail::FutexWait(&m_uStartState, uState, uWaitMs);
+    }
+
+    pthread_join(m_hThread, NULL);
+    m_bHasThread = false;
+    return true;
+}
+
+void* CWorkThreadBase::ThreadProc(void* lpParam)
+{
+    assert(lpParam);
+    CWorkThreadBase* pThis = (CWorkThreadBase*)lpParam;
+
+    pThis->m_dwThreadId = (unsigned int)syscall(SYS_gettid);
+    pThis->m_uStartState.store(1);
+    LockDetail::FutexWake(&pThis->m_uStartState, 1);
+
+    pThis->ApplyThreadOptions();
+    pThis->DoWork();
+    pThis->SetThrdRunning(false);
+    pThis->m_uStartState.store(2);
+    LockDetail::FutexWake(&pThis->m_uStartState, INT_MAX);
+    return NULL;
+}
+
+bool CWorkThreadBase::IsThrdRunning()
+{
+    return m_bThrdRunning.load(std::memory_order_acquire);
+}
+
+void CWorkThreadBase::SetThrdRunning( bool bRunning )
+{
+    m_bThrdRunning.store(bRunning, std::memory_order_release);
+}
+
+unsigned int CWorkThreadBase::GetThreadId() const
+{
+    return m_dwThreadId;
+}
+
+pthread_t CWorkThreadBase::GetThreadHandle() const
+{
+    return m_hThread;
+}
+
+// 解析/sys下的cpulist，如"0-3,8-11"
+static bool ReadNodeCpus(int nNode, cpu_set_t& cpuSet)
+{
+    char chPath[128] = {0};
+    snprintf(chPath, sizeof(chPath), "/sys/devices/system/node/node%d/cpulist", nNode);
+    FILE* fp = fopen(chPath, "r");
+    if(NULL == fp)
+    {
+        return false;
+    }
+
+    bool bAny = false;
+    int nFirst = 0;
+    int nLast = 0;
+    while(1 == fscanf(fp, "%d", &nFirst))
+    {
+        nLast = nFirst;
+        int ch = fgetc(fp);
+        if('-' == ch)
+        {
+            if(1 != fscanf(fp, "%d", &nLast))
+            {
+                break;
+            }
+            ch = fgetc(fp);
+        }
+        for(int nCpu = nFirst; nCpu <= nLast && nCpu < CPU_SETSIZE; ++nCpu)
+        {
+            CPU_SET(nCpu, &cpuSet);
+            bAny = true;
+        }
+        if(ch != ',')
+        {
+            break;
+        }
+    }
+    fclose(fp);
+    return bAny;
+}
+
+void CWorkThreadBase::ApplyThreadOptions()
+{
+    // 以下调用都只作用于调用线程本身
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    bool bBind = false;
+    for(size_t i = 0; i < m_vecCpus.size(); ++i)
+    {
+        if(m_vecCpus[i] >= 0 && m_vecCpus[i] < CPU_SETSIZE)
+        {
+            CPU_SET(m_vecCpus[i], &cpuSet);
+            bBind = true;
+        }
+    }
+    if(m_vecCpus.empty() && m_nNumaNode >= 0)
+    {
+        bBind = ReadNodeCpus(m_nNumaNode, cpuSet);
+    }
+    if(bBind && sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+    {
+#ifndef NO_XLOGGING
+        LOG_WARN << "sched_setaffinity failed. thread = " << m_dwThreadId << " errno = " << errno;
+#endif
+    }
+
+    // 首次访问时分配的页优先取自该节点，节点内存不足时仍可回退到其他节点
+    if(m_nNumaNode >= 0 && m_nNumaNode < (int)(sizeof(unsigned long) * 8))
+    {
+        unsigned long ulNodeMask = 1UL << m_nNumaNode;
+        if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, &ulNodeMask, sizeof(ulNodeMask) * 8 + 1) != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_WARN << "set_mempolicy failed. thread = " << m_dwThreadId << " errno = " << errno;
+#endif
+        }
+    }
+
+    if(PRIORITY_REALTIME == m_ePriority)
+    {
+        struct sched_param param;
+        param.sched_priority = m_nRealtimeLevel;
+        int nErr = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(nErr != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_WARN << "pthread_setschedparam failed. thread = " << m_dwThreadId << " errno = " << nErr;
+#endif
+        }
+    }
+    else if(m_ePriority != PRIORITY_DEFAULT)
+    {
+        // Linux下nice值是线程级的，按tid设置
+        int nNice = 0;
+        if(PRIORITY_LOW == m_ePriority)
+        {
+            nNice = 5;
+        }
+        else if(PRIORITY_HIGH == m_ePriority)
+        {
+            nNice = -5;
+        }
+        if(setpriority(PRIO_PROCESS, m_dwThreadId, nNice) != 0)
+        {
+#ifndef NO_XLOGGING
+            LOG_WARN << "setpriority failed. thread = " << m_dwThreadId << " errno = " << errno;
+#endif
+        }
+    }
+
+    if(!m_sThreadName.empty())
+    {
+        pthread_setname_np(pthread_self(), m_sThreadName.substr(0, 15).c_str());
+    }
+}
+#endif // _WIN32
+
+bool CWorkThreadBase::StopFor(uint32_t uTimeoutMs)
+{
+    RequestStop();
+    return WaitStopped(uTimeoutMs);
+}
+
+void CWorkThreadBase::StopAndWait()
+{
+    if(!Stop())
+    {
+        // 线程还在访问本对象，放它不管就会写已释放的内存，宁可一直等
+#ifndef NO_XLOGGING
+        LOG_ERROR << "Thread: " << m_dwThreadId << " outlived the heart time, waiting for it before destruction.";
+#endif
+        WaitStopped((uint32_t)-1);
+    }
+}
+
+bool CWorkThreadBase::IsThreadAlive() const
+{
+    return 1 == m_uStartState.load();
+}
+
+CStopToken CWorkThreadBase::GetStopToken()
+{
+    return CStopToken(&m_stopSource);
+}
+
+bool CWorkThreadBase::SleepFor(uint32_t uMs)
+{
+    return GetStopToken().SleepFor(uMs);
+}
+
+void CWorkThreadBase::SetCpuAffinity(const std::vector<int>& vecCpus)
+{
+    m_vecCpus = vecCpus;
+}
+
+void CWorkThreadBase::SetNumaNode(int nNode)
+{
+    m_nNumaNode = nNode;
+}
+
+void CWorkThreadBase::SetPriority(ThreadPriority ePriority, int nRealtimeLevel /* = 1 */)
+{
+    m_ePriority = ePriority;
+    m_nRealtimeLevel = nRealtimeLevel;
+}
+
+void CWorkThreadBase::SetThreadName(const std::string& sName)
+{
+    m_sThreadName = sName;
 }
@@ -9,11 +9,23 @@
 #ifndef WorkThreadBase_h__
 #define WorkThreadBase_h__
 #include <LockHelper.h>
+#include <atomic>
+#include <vector>
+#include <string>
+#include "StopToken.h"
+#ifndef _WIN32
+#include <pthread.h>
+#include <stdint.h>
+#endif
 
 class CWorkThreadBase
 {
 public:
+#ifdef _WIN32
     CWorkThreadBase(DWORD dwHeartExitTime = INFINITE);
+#else
+    CWorkThreadBase(uint32_t uHeartExitTime = (uint32_t)-1);
+#endif
     virtual ~CWorkThreadBase(void);
 
 private:
@@ -21,32 +33,130 @@ private:
     CWorkThreadBase& operator=(const CWorkThreadBase&);
 
 public:
+#ifdef _WIN32
     DWORD GetThreadId() const;
     HANDLE GetThreadHandle() const;
+    // 已废弃，新代码请用CMailboxThread::PostMsg；投递失败立即返回FALSE，不再Sleep重试
     BOOL SurePostMessage(UINT uMsg, WPARAM wp = 0, LPARAM lp = 0);
+#else
+    // 内核线程号(tid)
+    unsigned int GetThreadId() const;
+    pthread_t GetThreadHandle() const;
+#endif
+    // 线程函数是否仍在执行，含Stop超时后尚未退出的线程
+    bool IsThreadAlive() const;
+
+public:
+    // 线程优先级，Linux下NORMAL/LOW/HIGH调整nice值，REALTIME使用SCHED_FIFO（需CAP_SYS_NICE）
+    enum ThreadPriority
+    {
+        PRIORITY_DEFAULT = 0,   // 不做调整，继承创建者
+        PRIORITY_LOW,
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH,
+        PRIORITY_REALTIME,
+    };
+
+    // 以下线程属性须在Run之前设置，由新线程在执行DoWork前对自己生效；设置失败只告警，不影响线程运行
+
+    /** @fn void SetCpuAffinity(const std::vector<int>& vecCpus)
+     *  @brief 把线程绑定到指定的逻辑CPU集合，空集合表示不绑定；Windows下只支持第一个处理器组内的CPU
+     *  @param (IN) const std::vector<int>& vecCpus 逻辑CPU编号
+     */
+    void SetCpuAffinity(const std::vector<int>& vecCpus);
+
+    /** @fn void SetNumaNode(int nNode)
+     *  @brief 线程自身的内存分配优先取自该NUMA节点；未设置CPU集合时同时绑定到该节点的全部CPU
+     *  @param (IN) int nNode NUMA节点号，-1表示不指定
+     */
+    void SetNumaNode(int nNode);
+
+    /** @fn void SetPriority(ThreadPriority ePriority, int nRealtimeLevel = 1)
+     *  @param (IN) ThreadPriority ePriority 线程优先级
+     *  @param (IN) int nRealtimeLevel PRIORITY_REALTIME时Linux SCHED_FIFO的优先级（1~99），其余情况忽略
+     */
+    void SetPriority(ThreadPriority ePriority, int nRealtimeLevel = 1);
+
+    /** @fn void SetThreadName(const std::string& sName)
+     *  @brief 设置操作系统可见的线程名（top -H、gdb、VS调试器中显示），Linux下超过15个字符截断
+     */
+    void SetThreadName(const std::string& sName);
 
 protected:  // 默认设置为保护权限，是否开启接口由派生类重载决定
     // 启动工作线程
     virtual void Run();
-    // 结束工作线程
-    virtual void Stop();
+    /** @fn bool Stop()
+     *  @brief 结束工作线程：发出停止请求，至多等待心跳时间
+     *    心跳时间默认INFINITE，此时与旧版一样等到线程退出为止，派生类析构函数里直接调Stop的旧代码仍然安全；
+     *    需要限时返回的调用方（如滚动重启）改用StopFor，或在构造时给出有限的心跳时间
+     *    超时不强杀线程，只告警并放弃等待，线程仍归本对象所有，之后可再Stop/WaitStopped
+     *    析构路径不要直接用Stop，改用StopAndWait，以免超时返回后析构的对象仍被线程访问
+     *  @return bool 线程已退出（或本就没有线程）返回true，超时返回false
+     */
+    virtual bool Stop();
+
+    // 析构专用：Stop超时后告警并一直等到线程退出，返回时线程必定已回收；派生类析构函数里用它代替Stop
+    void StopAndWait();
+
+    /** @fn bool StopFor(uint32_t uTimeoutMs)
+     *  @brief 发出停止请求并至多等待uTimeoutMs毫秒，用于需要限时返回的场合（如滚动重启）
+     *  @return bool 线程已退出返回true；超时返回false，线程仍归本对象所有，之后可再次StopFor/Stop
+     */
+    bool StopFor(uint32_t uTimeoutMs);
+
+    // 发出停止请求，不等待：清运行标志、触发停止令牌（执行已登记的CStopCallback），Windows下另置退出事件并投递WM_QUIT
+    // Run返回前线程已建好消息队列，WM_QUIT不会投递失败
+    void RequestStop();
+
+    // 等待线程退出并回收，超时返回false
+    bool WaitStopped(uint32_t uTimeoutMs);
     
 protected:
     // 线程入口函数
+#ifdef _WIN32
     static unsigned int __stdcall ThreadProc(LPVOID lpParam);
+#else
+    static void* ThreadProc(void* lpParam);
+#endif
     // 线程执行体
     virtual void DoWork() = 0;
 
+    // 在新线程内应用CPU集合、NUMA节点、优先级与线程名
+    void ApplyThreadOptions();
+
     // 校验运行标志
     bool IsThrdRunning();
     void SetThrdRunning(bool bRunning);
 
+    // 线程内的阻塞等待应观察此令牌：睡眠用SleepFor，睡在其他对象上的等待登记CStopCallback唤醒自己
+    CStopToken GetStopToken();
+
+    // 可中断的Sleep，Stop时立即返回；睡满返回true
+    bool SleepFor(uint32_t uMs);
+
 protected:
+#ifdef _WIN32
     HANDLE        m_hThread;        // 线程句柄
     unsigned int  m_dwThreadId;     // 线程ID
-    volatile bool m_bThrdRunning;   // 运行标志位
+    std::atomic<bool> m_bThrdRunning;   // 运行标志位
     UINT          m_uHeartTime;     // 心跳时间
     HANDLE        m_hExitEvent;     // 线程退出事件
+    HANDLE        m_hStartEvent;    // 线程已建好消息队列，Run据此返回
+    std::atomic<uint32_t> m_uStartState;    // 0未启动，1已建好线程消息队列，2线程函数已返回
+#else
+    pthread_t     m_hThread;        // 线程句柄，m_bHasThread为true时有效
+    bool          m_bHasThread;     // 已创建且尚未join
+    unsigned int  m_dwThreadId;     // 线程ID
+    std::atomic<bool> m_bThrdRunning;   // 运行标志位
+    uint32_t      m_uHeartTime;     // 心跳时间，Stop超过此时间仍未退出则告警
+    std::atomic<uint32_t> m_uStartState;    // 0未启动，1已取得线程ID，2线程函数已返回
+#endif
+    std::vector<int> m_vecCpus;     // 绑定的CPU集合，空表示不绑定
+    int           m_nNumaNode;      // NUMA节点，-1表示不指定
+    ThreadPriority m_ePriority;     // 线程优先级
+    int           m_nRealtimeLevel; // 实时优先级
+    std::string   m_sThreadName;    // 线程名
+    CStopSource   m_stopSource;     // 停止请求，每次Run时复位
 };
 #endif // WorkThreadBase_h__
 
@@ -0,0 +1,150 @@
+/********************************************************************
+	filename: 	LockBench.cpp
+
+	purpose:	锁性能对比：1到N个线程争用同一把锁时的吞吐和公平性
+	            Windows下的CriticalSection、Linux下的std::mutex为基准，对比CFutexLock与CMcsLock
+	            独立程序，不参与工程构建，例如：
+	                g++ -std=c++17 -O2 -pthread -I.. LockBench.cpp -o LockBench
+	                ./LockBench [最大线程数] [每轮毫秒数]
+	            每个线程循环：加锁，改共享数据，解锁，再做一段锁外的计算
+	            输出每秒总加锁次数，以及线程间加锁次数的最小/最大比（越接近1越公平）
+*********************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FutexLock.h"
+#include "McsLock.h"
+
+namespace
+{
+    // 统一各种锁的接口
+    template<class TLock>
+    struct CLockAdapter
+    {
+        TLock lock;
+        void Lock()     { lock.Lock(); }
+        void Unlock()   { lock.Unlock(); }
+    };
+
+    template<>
+    struct CLockAdapter<std::mutex>
+    {
+        std::mutex lock;
+        void Lock()     { lock.lock(); }
+        void Unlock()   { lock.unlock(); }
+    };
+
+    struct alignas(64) CThreadResult
+    {
+        uint64_t uOps;
+    };
+
+    // 锁外的计算，模拟两次加锁之间的正常工作
+    inline uint64_t LocalWork(uint64_t x, int nRounds)
+    {
+        for(int i = 0; i < nRounds; ++i)
+        {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        return x;
+    }
+
+    template<class TLock>
+    void RunOne(const char* pszName, int nThreads, int nMillis, int nLocalWork)
+    {
+        CLockAdapter<TLock> lock;
+        uint64_t uShared[8] = {0};
+        std::atomic<bool> bStart(false);
+        std::atomic<bool> bStop(false);
+        std::vector<CThreadResult> vecResult(nThreads);
+        std::vector<std::thread> vecThreads;
+
+        for(int t = 0; t < nThreads; ++t)
+        {
+            vecThreads.push_back(std::thread([&, t]()
+            {
+                uint64_t uOps = 0;
+                uint64_t x = t + 1;
+                while(!bStart.load(std::memory_order_acquire))
+                {
+                }
+                while(!bStop.load(std::memory_order_relaxed))
+                {
+                    lock.Lock();
+                    for(int k = 0; k < 8; ++k)
+                    {
+                        uShared[k] += x;
+                    }
+                    lock.Unlock();
+                    x = LocalWork(x, nLocalWork);
+                    ++uOps;
+                }
+                vecResult[t].uOps = uOps;
+            }));
+        }
+
+        std::chrono::steady_clock::time_point tpBegin = std::chrono::steady_clock::now();
+        bStart.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(std::chrono::milliseconds(nMillis));
+        bStop.store(true, std::memory_order_relaxed);
+        for(size_t i = 0; i < vecThreads.size(); ++i)
+        {
+            vecThreads[i].join();
+        }
+        double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpBegin).count();
+
+        uint64_t uTotal = 0;
+        uint64_t uMin = (uint64_t)-1;
+        uint64_t uMax = 0;
+        for(int t = 0; t < nThreads; ++t)
+        {
+            uTotal += vecResult[t].uOps;
+            uMin = (vecResult[t].uOps < uMin) ? vecResult[t].uOps : uMin;
+            uMax = (vecResult[t].uOps > uMax) ? vecResult[t].uOps : uMax;
+        }
+        printf("%-16s threads=%-3d %10.2f Mops/s  fairness=%.2f\n",
+            pszName, nThreads, uTotal / dSeconds / 1e6, uMax ? (double)uMin / uMax : 0.0);
+    }
+
+    template<class TLock>
+    void RunSuite(const char* pszName, int nMaxThreads, int nMillis, int nLocalWork)
+    {
+        for(int nThreads = 1; nThreads <= nMaxThreads; nThreads *= 2)
+        {
+            RunOne<TLock>(pszName, nThreads, nMillis, nLocalWork);
+            if(nThreads < nMaxThreads && nThreads * 2 > nMaxThreads)
+            {
+                RunOne<TLock>(pszName, nMaxThreads, nMillis, nLocalWork);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int nMaxThreads = (argc > 1) ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    int nMillis = (argc > 2) ? atoi(argv[2]) : 300;
+    if(nMaxThreads <= 0)
+    {
+        nMaxThreads = 4;
+    }
+
+    // 临界区很短，锁外工作分别为几乎没有和约数百纳秒，对应高争用与中等争用
+    const int nLocalWorks[] = {0, 200};
+    for(size_t i = 0; i < sizeof(nLocalWorks) / sizeof(nLocalWorks[0]); ++i)
+    {
+        printf("== local work rounds: %d ==\n", nLocalWorks[i]);
+        RunSuite<std::mutex>("std::mutex", nMaxThreads, nMillis, nLocalWorks[i]);
+        RunSuite<CFutexLock>("CFutexLock", nMaxThreads, nMillis, nLocalWorks[i]);
+        RunSuite<CMcsLock>("CMcsLock", nMaxThreads, nMillis, nLocalWorks[i]);
+#ifdef _WIN32
+        RunSuite<CCriticalSectionLock>("CriticalSection", nMaxThreads, nMillis, nLocalWorks[i]);
+#endif
+    }
+    return 0;
+}